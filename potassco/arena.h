@@ -0,0 +1,158 @@
+//
+// Copyright (c) 2016-2017 Benjamin Kaufmann
+//
+// This file is part of Potassco.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+#ifndef POTASSCO_ARENA_H_INCLUDED
+#define POTASSCO_ARENA_H_INCLUDED
+#include <potassco/platform.h>
+namespace Potassco {
+/*!
+ * \addtogroup BasicTypes
+ */
+///@{
+
+//! Interface for allocating raw memory.
+/*!
+ * Components that accept an allocator obtain memory for their internal
+ * buffers from it. Unless documented otherwise, this covers all memory of the
+ * component. A null allocator always refers to mallocAllocator().
+ */
+class Allocator {
+public:
+	//! Alignment of memory returned by allocate() and reallocate().
+	enum { ALIGN = 2 * sizeof(void*) };
+	virtual ~Allocator();
+	//! Returns n bytes of uninitialized memory or fails with ENOMEM if no memory is available.
+	virtual void* allocate(std::size_t n) = 0;
+	//! Releases the memory block p of n bytes that was returned by this allocator.
+	virtual void  deallocate(void* p, std::size_t n) = 0;
+	//! Resizes the memory block p of n bytes to nn bytes.
+	/*!
+	 * The default implementation allocates a new block, copies min(n, nn) bytes,
+	 * and releases the old block.
+	 * \note If p is 0, the function behaves like allocate(nn).
+	 */
+	virtual void* reallocate(void* p, std::size_t n, std::size_t nn);
+};
+//! Returns an allocator that forwards to malloc(), realloc(), and free().
+Allocator& mallocAllocator();
+//! Returns alloc if it is not 0 and mallocAllocator() otherwise.
+inline Allocator& allocatorOrDefault(Allocator* alloc) { return alloc ? *alloc : mallocAllocator(); }
+
+//! A simple region-based allocator.
+/*!
+ * The class hands out memory from a list of (large) blocks obtained from an
+ * allocator. Allocated memory is never moved and can only be released all at once.
+ */
+class Arena {
+public:
+	enum { DEFAULT_BLOCK_SIZE = 16384 };
+	//! Creates an empty arena that allocates blocks of (at least) the given size from alloc.
+	explicit Arena(std::size_t blockSize = DEFAULT_BLOCK_SIZE, Allocator* alloc = 0);
+	~Arena();
+	//! Returns a pointer to n bytes of uninitialized memory aligned to the given power of two.
+	void*       allocate(std::size_t n, std::size_t align = sizeof(void*));
+	//! Tries to resize the last allocation p of n bytes to nn bytes in place.
+	/*!
+	 * \return Whether the memory block p now has a size of nn bytes.
+	 */
+	bool        extend(void* p, std::size_t n, std::size_t nn);
+	//! Returns a copy of the n objects starting at x followed by a value-initialized object.
+	template <class T>
+	T*          copy(const T* x, std::size_t n) {
+		T* r = static_cast<T*>(allocate((n + 1) * sizeof(T), alignOf<T>()));
+		for (std::size_t i = 0; i != n; ++i) { r[i] = x[i]; }
+		r[n] = T();
+		return r;
+	}
+	//! Releases all memory allocated from this arena.
+	void        release();
+	//! Swaps this and other.
+	void        swap(Arena& other);
+	//! Returns the number of bytes obtained from the system.
+	std::size_t capacity() const { return cap_; }
+	//! Returns the allocator from which blocks are obtained.
+	Allocator&  allocator() const { return *alloc_; }
+	template <class T>
+	static std::size_t alignOf() {
+		struct S { char c; T x; };
+		return sizeof(S) - sizeof(T);
+	}
+private:
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+	struct Block;
+	void* allocBlock(std::size_t n, std::size_t align);
+	Allocator*  alloc_;
+	Block*      head_;
+	char*       pos_;
+	char*       end_;
+	std::size_t block_;
+	std::size_t cap_;
+};
+inline void swap(Arena& lhs, Arena& rhs) { lhs.swap(rhs); }
+
+//! A bump allocator whose memory is released all at once.
+/*!
+ * Memory returned from deallocate() is only reclaimed once release() is called
+ * or the object is destroyed. Hence, objects that use this allocator must not be
+ * used after the allocator was released.
+ */
+class ArenaAllocator : public Allocator {
+public:
+	//! Creates an allocator that obtains blocks of (at least) the given size from upstream.
+	explicit ArenaAllocator(std::size_t blockSize = 1u << 20, Allocator* upstream = 0);
+	virtual void* allocate(std::size_t n);
+	virtual void  deallocate(void* p, std::size_t n);
+	virtual void* reallocate(void* p, std::size_t n, std::size_t nn);
+	//! Releases all memory allocated from this object.
+	void          release() { arena_.release(); }
+	//! Returns the number of bytes obtained from the upstream allocator.
+	std::size_t   capacity() const { return arena_.capacity(); }
+private:
+	Arena arena_;
+};
+
+//! An allocator that backs large allocations by (transparent) huge pages if supported.
+/*!
+ * Allocations of at least the given threshold are rounded up to a multiple of
+ * the huge page size and mapped directly from the operating system with a hint
+ * to use huge pages. All other allocations are forwarded to malloc().
+ *
+ * \note On systems without support for huge pages, all allocations are forwarded to malloc().
+ */
+class HugePageAllocator : public Allocator {
+public:
+	enum { HUGE_PAGE_SIZE = 2u << 20 };
+	explicit HugePageAllocator(std::size_t threshold = HUGE_PAGE_SIZE / 2);
+	virtual void* allocate(std::size_t n);
+	virtual void  deallocate(void* p, std::size_t n);
+	virtual void* reallocate(void* p, std::size_t n, std::size_t nn);
+	//! Returns whether huge pages are supported on this system.
+	static bool   supported();
+private:
+	bool mapped(std::size_t n) const;
+	std::size_t threshold_;
+};
+///@}
+} // namespace Potassco
+#endif
@@ -86,6 +86,8 @@ public:
 	virtual void rule(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& lits);
 	//! Writes an aspif minimize directive.
 	virtual void minimize(Weight_t prio, const WeightLitSpan& lits);
+	//! Writes an aspif rule or minimize directive for each rule of the batch.
+	virtual void rules(const RuleBatch& batch);
 	//! Writes an aspif output directive.
 	virtual void output(const StringSpan& str, const LitSpan& cond);
 	//! Writes an aspif external directive.
@@ -28,6 +28,7 @@
 #include <cstring>
 #include <string>
 namespace Potassco {
+class StringBuilder;
 //! Class for parsing logic programs in ground text format.
 /*!
  * \ingroup ParseType
@@ -77,7 +78,14 @@ private:
  */
 class AspifTextOutput : public Potassco::AbstractProgram {
 public:
-	AspifTextOutput(std::ostream& os);
+	//! Creates a new object that writes to os.
+	/*!
+	 * Memory for theory data and the atom map is obtained from alloc or from the
+	 * default allocator if alloc is 0.
+	 * \note The allocator is not used for the buffered directives, names, and
+	 *       conditions of a step, which are kept in standard containers.
+	 */
+	AspifTextOutput(std::ostream& os, Allocator* alloc = 0);
 	~AspifTextOutput();
 	virtual void initProgram(bool incremental);
 	virtual void beginStep();
@@ -100,15 +108,28 @@ public:
 	virtual void endStep();
 
 	void addAtom(Atom_t id, const StringSpan& str);
+	//! Sets the number of threads to use for writing the directives of a step.
+	/*!
+	 * If n is not 1, the directives of a step are split into consecutive ranges,
+	 * which are rendered into separate buffers by up to n threads and then
+	 * written to the output stream in their original order.
+	 * A value of 0 uses one thread per hardware thread.
+	 *
+	 * \note If the library was built without thread support, the value is ignored.
+	 */
+	void setThreads(unsigned n);
 private:
+	struct Render;
 	std::ostream& printName(std::ostream& os, Lit_t lit) const;
 	void writeDirectives();
+	void writeDirectives(std::ostream& os, uint32_t pos, uint32_t end) const;
 	void visitTheories();
+	AspifTextOutput& startDir(Directive_t d);
 	AspifTextOutput& push(uint32_t x);
 	AspifTextOutput& push(const AtomSpan& atoms);
 	AspifTextOutput& push(const LitSpan&  lits);
 	AspifTextOutput& push(const WeightLitSpan& wlits);
-	template <class T> T get();
+	template <class T> T get(uint32_t& pos) const;
 	AspifTextOutput(const AspifTextOutput&);
 	AspifTextOutput& operator=(const AspifTextOutput&);
 	std::ostream& os_;
@@ -116,23 +137,44 @@ private:
 	TheoryData theory_;
 	Data*      data_;
 	int        step_;
+	unsigned   threads_;
 };
 
 //! Converts a given theory atom to a string.
+/*!
+ * The string representations of compound terms are cached by term id so that
+ * shared subterms are only rendered once. The cache is bound to the term version
+ * (see TheoryData::termVersion()) of the TheoryData object last passed to toString()
+ * and is dropped whenever a different object is passed or terms were removed from
+ * (or reset in) that object, i.e. it stays valid across calls to TheoryData::update().
+ * Long representations are not cached and the cache is dropped once its
+ * total size exceeds a fixed limit, so its memory stays bounded.
+ */
 class TheoryAtomStringBuilder {
 public:
-	std::string toString(const TheoryData& td, const TheoryAtom& a);
+	TheoryAtomStringBuilder();
+	virtual ~TheoryAtomStringBuilder();
+	//! Returns the string representation of the given theory atom.
+	std::string    toString(const TheoryData& td, const TheoryAtom& a);
+	//! Appends the string representation of the given theory atom to out.
+	StringBuilder& toString(const TheoryData& td, const TheoryAtom& a, StringBuilder& out);
+	//! Drops all cached term representations and releases their memory.
+	void           clearCache();
 private:
-	TheoryAtomStringBuilder& add(char c) { res_.append(1, c); return *this; }
-	TheoryAtomStringBuilder& add(const char* s) { res_.append(s); return *this; }
-	TheoryAtomStringBuilder& add(const std::string& s) { res_.append(s); return *this; }
-	TheoryAtomStringBuilder& term(const TheoryData& td, const TheoryTerm& a);
+	TheoryAtomStringBuilder(const TheoryAtomStringBuilder&);
+	TheoryAtomStringBuilder& operator=(const TheoryAtomStringBuilder&);
+	TheoryAtomStringBuilder& add(char c);
+	TheoryAtomStringBuilder& add(const char* s);
+	TheoryAtomStringBuilder& add(const std::string& s);
+	TheoryAtomStringBuilder& term(const TheoryData& td, Id_t termId);
 	TheoryAtomStringBuilder& element(const TheoryData& td, const TheoryElement& a);
 	bool function(const TheoryData& td, const TheoryTerm& f);
 
 	virtual LitSpan     getCondition(Id_t condId) const = 0;
 	virtual std::string getName(Atom_t atomId)    const = 0;
-	std::string res_;
+	struct Cache;
+	StringBuilder* out_;
+	Cache*         cache_;
 };
 
 } // namespace Potassco
@@ -143,6 +143,7 @@ struct Directive_t {
 	);
 };
 
+class RuleBatch;
 //! Basic callback interface for constructing a logic program.
 class AbstractProgram {
 public:
@@ -158,6 +159,11 @@ public:
 	virtual void rule(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& body) = 0;
 	//! Add the given minimize statement to the program.
 	virtual void minimize(Weight_t prio, const WeightLitSpan& lits) = 0;
+	//! Add all rules and minimize statements of the given batch in the order in which they were added.
+	/*!
+	 * The default implementation calls rule() or minimize() for each entry of the batch.
+	 */
+	virtual void rules(const RuleBatch& batch);
 
 	/*!
 	* \name Advanced
@@ -294,16 +300,18 @@ inline const char* toString(Heuristic_t t) {
 ///@}
 ///@}
 
+class Allocator;
 //! A (dynamic-sized) block of raw memory.
 /*!
- * The class manages a (dynamic-sized) block of memory obtained by malloc/realloc
- * and uses a simple geometric scheme when the block needs to grow.
+ * The class manages a (dynamic-sized) block of memory obtained from an allocator
+ * (by default malloc/realloc) and uses a simple geometric scheme when the block
+ * needs to grow.
  *
  * \ingroup ParseType
  */
 class MemoryRegion {
 public:
-	explicit MemoryRegion(std::size_t initialSize = 0);
+	explicit MemoryRegion(std::size_t initialSize = 0, Allocator* alloc = 0);
 	~MemoryRegion();
 	//! Returns the current region size.
 	std::size_t size()     const { return static_cast<std::size_t>(static_cast<unsigned char*>(end_) - static_cast<unsigned char*>(beg_)); }
@@ -324,6 +332,8 @@ public:
 	void        grow(std::size_t n = 0);
 	//! Swaps this and other.
 	void        swap(MemoryRegion& other);
+	//! Returns the allocator from which memory is obtained.
+	Allocator&  allocator() const { return *alloc_; }
 	//! Releases the region and its memory.
 	/*!
 	 * \post size() == 0
@@ -332,8 +342,9 @@ public:
 private:
 	MemoryRegion(const MemoryRegion&);
 	MemoryRegion& operator=(const MemoryRegion&);
-	void* beg_;
-	void* end_;
+	void*      beg_;
+	void*      end_;
+	Allocator* alloc_;
 };
 inline void swap(MemoryRegion& lhs, MemoryRegion& rhs) { lhs.swap(rhs); }
 class RuleBuilder;
@@ -100,6 +100,28 @@ public:
 	 */
 	uint32_t trailEnd(uint32_t level) const;
 
+	//! Stores the truth value of each literal in lits in the corresponding position of out.
+	/*!
+	 * The default implementation calls value() for each literal.
+	 * \pre out has space for at least size(lits) values.
+	 */
+	virtual void     values(const LitSpan& lits, Value_t* out) const;
+	//! Stores the decision level of each literal in lits in the corresponding position of out.
+	/*!
+	 * The default implementation calls level(Lit_t) for each literal.
+	 * \pre out has space for at least size(lits) values.
+	 */
+	virtual void     levels(const LitSpan& lits, uint32_t* out) const;
+	//! Returns the literals in the trail positions [pos, pos + n).
+	/*!
+	 * The returned span either refers to the internal trail of the assignment, in
+	 * which case it is only valid until the assignment changes, or to buf, which
+	 * shall have space for at least n literals.
+	 * The default implementation copies the literals to buf via trailAt().
+	 * \pre pos + n <= trailSize()
+	 */
+	virtual LitSpan  trail(uint32_t pos, uint32_t n, Lit_t* buf) const;
+
 	//! Returns whether the current assignment is total.
 	/*!
 	 * The default implementation returns unassigned() == 0.
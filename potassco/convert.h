@@ -42,8 +42,12 @@ public:
 	 * Otherwise, heuristic and edge directives are not converted but
 	 * directly passed to out, while external directives are mapped to
 	 * choice rules or integrity constraints.
+	 * \param alloc Allocator for the atom map, names, and the table of conditions
+	 *              or 0 for the default allocator.
+	 * \note The allocator is not used for the buffered directives of a step,
+	 *       which are kept in standard containers.
 	 */
-	SmodelsConvert(AbstractProgram& out, bool enableClaspExt);
+	SmodelsConvert(AbstractProgram& out, bool enableClaspExt, Allocator* alloc = 0);
 	~SmodelsConvert();
 	//! Calls initProgram() on the associated output program.
 	virtual void initProgram(bool incremental);
@@ -73,8 +77,31 @@ public:
 	const char* getName(Atom_t a) const;
 	//! Returns the max used smodels atom (valid atoms are [1..n]).
 	unsigned    maxAtom() const;
+	//! Sets the maximal number of bytes used for buffering the directives of a step.
+	/*!
+	 * Outputs, minimize literals, externals, and heuristics are buffered until the end
+	 * of a step. If n is not 0 and the buffered data exceeds n bytes, it is moved to a
+	 * temporary file and read back when the step is finished.
+	 * The default is 0, i.e. all data is kept in memory.
+	 * \note Names that are returned by getName() are always kept in memory.
+	 */
+	void        setSpillLimit(std::size_t n);
+	//! Sets the maximal number of bytes used for remembering the auxiliary atoms of conditions.
+	/*!
+	 * Conditions of outputs, heuristics, and edges are mapped to auxiliary atoms
+	 * so that equivalent conditions share one rule (see makeAtom()). Once the table
+	 * exceeds n bytes, it is cleared and later conditions get new auxiliary atoms.
+	 * Clearing never affects the converted program's meaning, only its size.
+	 * If n is 0, the table is not limited. The default is 64 MB.
+	 */
+	void        setConditionLimit(std::size_t n);
 protected:
 	//! Creates a (named) atom that is equivalent to the given condition.
+	/*!
+	 * Auxiliary atoms created for conditions are shared between all calls
+	 * (of all steps) with the same set of literals unless the table of
+	 * conditions was cleared in between (see setConditionLimit()).
+	 */
 	Atom_t makeAtom(const LitSpan& lits, bool named);
 	//! Processes all outstanding conversions.
 	void flush();
@@ -27,6 +27,7 @@
 #include <stdexcept>
 #include <climits>
 #include <iosfwd>
+#include <string>
 #include <stdint.h>
 namespace Potassco {
 
@@ -65,6 +66,15 @@ public:
 	 * \return The number of characters copied to bufferOut.
 	 */
 	int  copy(char* bufferOut, int max);
+	//! Extracts the characters up to and including the next newline and returns them (excluding the newline) in line.
+	/*!
+	 * If the line fits into the read buffer, line references the buffer directly.
+	 * Otherwise, the line is copied to temp and line references temp.
+	 * In either case, line is zero-terminated and only valid until the next
+	 * operation on this object.
+	 * \return Whether the line was terminated by a newline as opposed to the end of input.
+	 */
+	bool readLine(StringSpan& line, std::string& temp);
 	//! Returns the current line number in the input stream, i.e. the number of '\n' characters extracted so far.
 	unsigned line() const;
 	//! Returns whether the given character is a decimal digit.
@@ -79,6 +89,7 @@ private:
 	enum { ALLOC_SIZE = BUF_SIZE + 1 };
 	BufferedStream& operator=(const BufferedStream&);
 	void underflow(bool up = true);
+	bool lineInBuffer(std::size_t eol) const;
 	typedef char* BufferType;
 	std::istream& str_;
 	BufferType    buf_;
@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2016-2017 Benjamin Kaufmann
+//
+// This file is part of Potassco.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+#ifndef POTASSCO_PAGED_MAP_H_INCLUDED
+#define POTASSCO_PAGED_MAP_H_INCLUDED
+#include <potassco/basic_types.h>
+#include <potassco/arena.h>
+#include <algorithm>
+#include <cstring>
+namespace Potassco {
+/*!
+ * \addtogroup BasicTypes
+ */
+///@{
+
+//! A map from (possibly sparse) ids to values of type T.
+/*!
+ * Values of a dense prefix of ids are stored in a flat array, while values of
+ * all other ids are stored in fixed-size pages of 2^PageBits values that are
+ * allocated on first write. Hence, memory usage is proportional to the
+ * number of pages in use rather than to the largest id.
+ *
+ * Ids without a value map to the default value given on construction.
+ * \tparam T The value type. T must be trivially copyable.
+ * \note References to values are invalidated by subsequent write accesses.
+ */
+template <class T, unsigned PageBits = 12>
+class PagedMap {
+public:
+	enum { PAGE_SIZE = 1u << PageBits, PAGE_MASK = PAGE_SIZE - 1 };
+	//! Creates an empty map with the given default value that obtains its memory from alloc.
+	explicit PagedMap(const T& def = T(), Allocator* alloc = 0)
+		: def_(def), dense_(0), pages_(0), nDense_(0), capDense_(0), nPages_(0), alloc_(&allocatorOrDefault(alloc)) {}
+	~PagedMap() { clear(); }
+
+	//! Returns the value of the given id or the default value if no value was set.
+	const T& get(Id_t id) const {
+		const T* x = find(id);
+		return x ? *x : def_;
+	}
+	//! Returns a pointer to the slot of the given id or 0 if no such slot was allocated yet.
+	/*!
+	 * A slot that was allocated but not yet written contains the default value.
+	 */
+	const T* find(Id_t id) const {
+		if (id < nDense_) { return dense_ + id; }
+		std::size_t p = id >> PageBits;
+		return p < nPages_ && pages_[p] ? pages_[p] + (id & PAGE_MASK) : 0;
+	}
+	T*       find(Id_t id) { return const_cast<T*>(static_cast<const PagedMap&>(*this).find(id)); }
+	//! Returns a reference to the value of the given id, which is created if necessary.
+	T& operator[](Id_t id) {
+		if (T* x = find(id)) { return *x; }
+		if (id < std::max(static_cast<std::size_t>(PAGE_SIZE), nDense_ * 2)) {
+			grow(id);
+			return dense_[id];
+		}
+		std::size_t p = id >> PageBits;
+		if (p >= nPages_) {
+			std::size_t np = std::max(p + 1, nPages_ * 2);
+			pages_ = static_cast<T**>(alloc_->reallocate(pages_, nPages_ * sizeof(T*), np * sizeof(T*)));
+			std::fill(pages_ + nPages_, pages_ + np, static_cast<T*>(0));
+			nPages_ = np;
+		}
+		T* page = static_cast<T*>(alloc_->allocate(PAGE_SIZE * sizeof(T)));
+		std::fill(page, page + PAGE_SIZE, def_);
+		return (pages_[p] = page)[id & PAGE_MASK];
+	}
+	//! Returns the default value.
+	const T& defaultValue() const { return def_; }
+	//! Returns the allocator from which memory is obtained.
+	Allocator& allocator() const { return *alloc_; }
+	//! Removes all values from this map and releases its memory.
+	void clear() {
+		for (std::size_t p = 0; p != nPages_; ++p) {
+			if (pages_[p]) { alloc_->deallocate(pages_[p], PAGE_SIZE * sizeof(T)); }
+		}
+		if (pages_) { alloc_->deallocate(pages_, nPages_ * sizeof(T*)); }
+		if (dense_) { alloc_->deallocate(dense_, capDense_ * sizeof(T)); }
+		dense_ = 0;
+		pages_ = 0;
+		nDense_ = capDense_ = nPages_ = 0;
+	}
+	//! Swaps this and other.
+	void swap(PagedMap& other) {
+		std::swap(def_, other.def_);
+		std::swap(dense_, other.dense_);
+		std::swap(pages_, other.pages_);
+		std::swap(nDense_, other.nDense_);
+		std::swap(capDense_, other.capDense_);
+		std::swap(nPages_, other.nPages_);
+		std::swap(alloc_, other.alloc_);
+	}
+private:
+	PagedMap(const PagedMap&);
+	PagedMap& operator=(const PagedMap&);
+	// Extends the dense prefix to a multiple of PAGE_SIZE > id and moves values from covered pages.
+	void grow(Id_t id) {
+		std::size_t n = ((static_cast<std::size_t>(id) >> PageBits) + 1) << PageBits;
+		if (n > capDense_) {
+			std::size_t nc = std::max(n, capDense_ * 2);
+			dense_    = static_cast<T*>(alloc_->reallocate(dense_, capDense_ * sizeof(T), nc * sizeof(T)));
+			capDense_ = nc;
+		}
+		for (std::size_t p = nDense_ >> PageBits; p != (n >> PageBits); ++p) {
+			T* out = dense_ + (p << PageBits);
+			if (p < nPages_ && pages_[p]) {
+				std::memcpy(static_cast<void*>(out), pages_[p], PAGE_SIZE * sizeof(T));
+				alloc_->deallocate(pages_[p], PAGE_SIZE * sizeof(T));
+				pages_[p] = 0;
+			}
+			else { std::fill(out, out + PAGE_SIZE, def_); }
+		}
+		nDense_ = n;
+	}
+	T           def_;
+	T*          dense_;
+	T**         pages_;
+	std::size_t nDense_;
+	std::size_t capDense_;
+	std::size_t nPages_;
+	Allocator*  alloc_;
+};
+///@}
+} // namespace Potassco
+#endif
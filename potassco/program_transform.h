@@ -0,0 +1,206 @@
+//
+// Copyright (c) 2016-2017 Benjamin Kaufmann
+//
+// This file is part of Potassco.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+#ifndef POTASSCO_PROGRAM_TRANSFORM_H_INCLUDED
+#define POTASSCO_PROGRAM_TRANSFORM_H_INCLUDED
+#include <potassco/basic_types.h>
+namespace Potassco {
+/*!
+ * \addtogroup WriteType
+ */
+///@{
+
+//! Renumbers the atoms of a program into a dense range.
+/*!
+ * Atoms are numbered 1..n in the order of their first occurrence in any rule or
+ * directive, and all rules and directives are then passed to the associated
+ * output program with their atoms renumbered. The mapping is kept across
+ * incremental steps and can be used to translate atoms of the output program back.
+ */
+class AtomCompactor : public AbstractProgram {
+public:
+	//! Creates a new object that passes renumbered programs to out.
+	explicit AtomCompactor(AbstractProgram& out);
+	~AtomCompactor();
+
+	virtual void initProgram(bool incremental);
+	virtual void beginStep();
+	virtual void rule(Head_t ht, const AtomSpan& head, const LitSpan& body);
+	virtual void rule(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& body);
+	virtual void minimize(Weight_t prio, const WeightLitSpan& lits);
+	virtual void project(const AtomSpan& atoms);
+	virtual void output(const StringSpan& str, const LitSpan& condition);
+	virtual void external(Atom_t a, Value_t v);
+	virtual void assume(const LitSpan& lits);
+	virtual void heuristic(Atom_t a, Heuristic_t t, int bias, unsigned prio, const LitSpan& condition);
+	virtual void acycEdge(int s, int t, const LitSpan& condition);
+	virtual void theoryTerm(Id_t termId, int number);
+	virtual void theoryTerm(Id_t termId, const StringSpan& name);
+	virtual void theoryTerm(Id_t termId, int cId, const IdSpan& args);
+	virtual void theoryElement(Id_t elementId, const IdSpan& terms, const LitSpan& cond);
+	virtual void theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements);
+	virtual void theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements, Id_t op, Id_t rhs);
+	virtual void endStep();
+
+	//! Returns the output literal of the given input literal or 0 if its atom was not yet used.
+	Lit_t  get(Lit_t lit) const;
+	//! Returns the input atom that was mapped to the given output atom or 0 if no such atom exists.
+	Atom_t original(Atom_t a) const;
+	//! Returns the max used output atom (valid atoms are [1..n]).
+	Atom_t maxAtom() const;
+private:
+	AtomCompactor(const AtomCompactor&);
+	AtomCompactor& operator=(const AtomCompactor&);
+	struct Data;
+	AbstractProgram& out_;
+	Data*            data_;
+};
+//! Removes duplicate rules and directives from a program.
+/*!
+ * Rules, output directives and (optionally) minimize directives are passed to
+ * the associated output program only on their first occurrence. Two rules are
+ * considered equal if they have the same head and body type, the same set of head
+ * atoms, and either the same set of body literals or the same bound and
+ * weight literals, where duplicate weight literals are merged (see mergeDuplicates()).
+ * All other directives are passed through unchanged.
+ */
+class DuplicateFilter : public AbstractProgram {
+public:
+	//! Options for configuring the filter.
+	struct Options {
+		Options() : stepScope(false), minimize(false) {}
+		//! Only remove duplicates within a step, i.e. forget all seen rules at the end of each step.
+		/*!
+		 * This bounds memory usage in incremental programs to the size of the largest step.
+		 */
+		Options& perStep() { stepScope = true; return *this; }
+		//! Also remove duplicate minimize directives.
+		/*!
+		 * \note Weights of duplicate minimize directives with the same priority
+		 *       add up. Hence, removing duplicates changes the optimization semantics:
+		 *       it preserves the set of optimal models only if all distinct directives
+		 *       of a priority occur equally often, e.g. if each is duplicated once.
+		 *       Otherwise, optimal models may change, e.g. given S, S, and {b=1} with
+		 *       S = {a=1}, the costs a+a vs. b become a vs. b after filtering.
+		 */
+		Options& filterMinimize() { minimize = true; return *this; }
+		bool stepScope;
+		bool minimize;
+	};
+	//! Creates a new object that passes programs without duplicates to out.
+	explicit DuplicateFilter(AbstractProgram& out, const Options& opts = Options());
+	~DuplicateFilter();
+
+	virtual void initProgram(bool incremental);
+	virtual void beginStep();
+	virtual void rule(Head_t ht, const AtomSpan& head, const LitSpan& body);
+	virtual void rule(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& body);
+	virtual void minimize(Weight_t prio, const WeightLitSpan& lits);
+	virtual void project(const AtomSpan& atoms);
+	virtual void output(const StringSpan& str, const LitSpan& condition);
+	virtual void external(Atom_t a, Value_t v);
+	virtual void assume(const LitSpan& lits);
+	virtual void heuristic(Atom_t a, Heuristic_t t, int bias, unsigned prio, const LitSpan& condition);
+	virtual void acycEdge(int s, int t, const LitSpan& condition);
+	virtual void theoryTerm(Id_t termId, int number);
+	virtual void theoryTerm(Id_t termId, const StringSpan& name);
+	virtual void theoryTerm(Id_t termId, int cId, const IdSpan& args);
+	virtual void theoryElement(Id_t elementId, const IdSpan& terms, const LitSpan& cond);
+	virtual void theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements);
+	virtual void theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements, Id_t op, Id_t rhs);
+	virtual void endStep();
+
+	//! Returns the number of duplicates removed so far.
+	uint64_t duplicates() const { return dups_; }
+private:
+	DuplicateFilter(const DuplicateFilter&);
+	DuplicateFilter& operator=(const DuplicateFilter&);
+	struct Data;
+	AbstractProgram& out_;
+	Data*            data_;
+	Options          opts_;
+	uint64_t         dups_;
+};
+//! Simplifies a program with respect to its facts.
+/*!
+ * Atoms are considered facts if they are the single head atom of a disjunctive
+ * rule whose body is (or became) empty. Rules of a step are buffered and simplified
+ * w.r.t. the facts known so far:
+ *  - True body literals are removed and the bound of a sum body is adjusted accordingly.
+ *  - Rules with a false body and disjunctive rules with a true head atom are removed.
+ *  - Facts are removed from the heads of choice rules.
+ *  - Output directives are simplified like normal bodies.
+ *
+ * Since facts may be derived from rules that were simplified before, the buffered rules
+ * are simplified repeatedly at the end of each step until either no new fact is derived
+ * or the maximal number of passes is reached. The remaining rules are then passed to the
+ * associated output program before the step is ended. All other directives are
+ * passed through unchanged.
+ *
+ * Facts are kept across incremental steps. The value of an external atom is never
+ * considered a fact because it may change in subsequent steps.
+ */
+class FactPropagator : public AbstractProgram {
+public:
+	//! Creates a new object that passes simplified programs to out.
+	/*!
+	 * \param out The program to which simplified programs are passed.
+	 * \param maxPasses Maximal number of simplification passes at the end of a step.
+	 */
+	explicit FactPropagator(AbstractProgram& out, unsigned maxPasses = 3);
+	~FactPropagator();
+
+	virtual void initProgram(bool incremental);
+	virtual void beginStep();
+	virtual void rule(Head_t ht, const AtomSpan& head, const LitSpan& body);
+	virtual void rule(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& body);
+	virtual void minimize(Weight_t prio, const WeightLitSpan& lits);
+	virtual void project(const AtomSpan& atoms);
+	virtual void output(const StringSpan& str, const LitSpan& condition);
+	virtual void external(Atom_t a, Value_t v);
+	virtual void assume(const LitSpan& lits);
+	virtual void heuristic(Atom_t a, Heuristic_t t, int bias, unsigned prio, const LitSpan& condition);
+	virtual void acycEdge(int s, int t, const LitSpan& condition);
+	virtual void theoryTerm(Id_t termId, int number);
+	virtual void theoryTerm(Id_t termId, const StringSpan& name);
+	virtual void theoryTerm(Id_t termId, int cId, const IdSpan& args);
+	virtual void theoryElement(Id_t elementId, const IdSpan& terms, const LitSpan& cond);
+	virtual void theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements);
+	virtual void theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements, Id_t op, Id_t rhs);
+	virtual void endStep();
+
+	//! Returns whether the given atom is a known fact.
+	bool     isFact(Atom_t a) const;
+	//! Returns the number of rules and output directives removed so far.
+	uint64_t removed() const;
+private:
+	FactPropagator(const FactPropagator&);
+	FactPropagator& operator=(const FactPropagator&);
+	struct Data;
+	AbstractProgram& out_;
+	Data*            data_;
+	unsigned         passes_;
+};
+///@}
+} // namespace Potassco
+#endif
@@ -25,6 +25,7 @@
 #define POTASSCO_RULE_UTILS_H_INCLUDED
 #include <potassco/match_basic_types.h>
 #include <new>
+#include <vector>
 namespace Potassco {
 /*!
  * \addtogroup BasicTypes
@@ -57,10 +58,51 @@ struct Rule_t {
 	bool sum()    const { return bt != Body_t::Normal; }
 };
 
+/*!
+ * \name Normalization functions
+ * Functions for normalizing the elements of rules in place.
+ *
+ * Literals are ordered by atom and, for the same atom, a positive literal
+ * precedes its complement. Hence, duplicate and complementary literals are
+ * adjacent after sorting.
+ */
+//@{
+//! Sorts the given atoms and removes duplicates.
+/*!
+ * \return The new end of the range.
+ */
+Atom_t*      sortUnique(Atom_t* first, Atom_t* last);
+//! Sorts the given literals and removes duplicates.
+/*!
+ * \return The new end of the range.
+ */
+Lit_t*       sortUnique(Lit_t* first, Lit_t* last);
+//! Returns whether the given sorted range contains a literal together with its complement.
+bool         hasComplement(const Lit_t* first, const Lit_t* last);
+//! Sorts the given weight literals and merges duplicate literals by adding their weights.
+/*!
+ * Literals whose (merged) weight is 0 are removed. A merged weight that exceeds
+ * the range of Weight_t is split into several copies of the literal.
+ * \return The new end of the range.
+ */
+WeightLit_t* mergeDuplicates(WeightLit_t* first, WeightLit_t* last);
+//! Normalizes the given sum aggregate such that all literals are distinct and have positive weights.
+/*!
+ * Literals with negative weights are replaced by their complement and complementary
+ * literals are combined. The bound is adjusted accordingly and weights exceeding
+ * the adjusted bound may be reduced to it.
+ * \throw std::overflow_error if the adjusted bound exceeds the range of Weight_t
+ *        and the sum is satisfiable.
+ * \return The new end of the range.
+ */
+WeightLit_t* normalizeSum(WeightLit_t* first, WeightLit_t* last, Weight_t& bound);
+//@}
+
 //! A builder class for creating a rule.
 class RuleBuilder {
 public:
-	RuleBuilder();
+	//! Creates a new builder that obtains its memory from the given allocator.
+	explicit RuleBuilder(Allocator* alloc = 0);
 	RuleBuilder(const RuleBuilder&);
 	RuleBuilder& operator=(const RuleBuilder&);
 	~RuleBuilder();
@@ -101,6 +143,12 @@ public:
 	//! Add lit with given weight to rule's body if body is a sum aggregate or rule is a minimize rule.
 	RuleBuilder& addGoal(Lit_t lit, Weight_t w) { WeightLit_t p = {lit, w}; return addGoal(p); }
 	RuleBuilder& addGoal(WeightLit_t lit);
+	//! Reserves space for adding the given number of head atoms and body literals.
+	/*!
+	 * The function is a hint for avoiding repeated reallocations when the
+	 * size of a (large) rule is known in advance.
+	 */
+	RuleBuilder& reserve(std::size_t numHead, std::size_t numBody);
 	//@}
 
 	//! Stop definition of rule and add rule to out if given.
@@ -116,6 +164,19 @@ public:
 	RuleBuilder& clearHead();
 	//! Weaken active sum aggregate body to a normal body or count aggregate.
 	RuleBuilder& weaken(Body_t to, bool resetWeights = true);
+	//! Possible states of a normalized rule body.
+	enum BodyState { BodyOpen = 0, BodyTrue = 1, BodyFalse = 2 };
+	//! Normalizes head and body of the active rule in place.
+	/*!
+	 * Head atoms and the literals of a normal body are sorted and duplicates are removed.
+	 * A sum body is normalized via normalizeSum() and becomes a sum aggregate if
+	 * it was a count aggregate but merging changed some weights. For minimize rules,
+	 * only duplicate literals are merged.
+	 *
+	 * \return BodyFalse if the body can never be satisfied, BodyTrue if it is trivially
+	 *         satisfied, and BodyOpen otherwise. The state of minimize rules is always BodyOpen.
+	 */
+	BodyState    normalize();
 
 	/*!
 	 * \name Query functions
@@ -128,6 +189,7 @@ public:
 	Atom_t*       head_begin()  const;
 	Atom_t*       head_end()    const;
 	Body_t        bodyType()    const;
+	bool          isMinimize()  const;
 	LitSpan       body()        const;
 	Sum_t         sum()         const;
 	Rule_t        rule()        const;
@@ -146,6 +208,65 @@ private:
 	Rule*     unfreeze(bool clear);
 	MemoryRegion mem_;
 };
+
+//! A container for storing a sequence of rules in one contiguous buffer.
+/*!
+ * Rules are appended in the order in which they are added and can be accessed
+ * by index or passed to an AbstractProgram in one call. Other than a RuleBuilder,
+ * the container is not reset per rule and hence allows producers to build large
+ * blocks of rules without per-rule overhead.
+ */
+class RuleBatch {
+public:
+	//! Creates an empty batch that obtains its memory from the given allocator.
+	explicit RuleBatch(Allocator* alloc = 0);
+	~RuleBatch();
+	void swap(RuleBatch& other);
+
+	//! Returns the number of rules in the batch.
+	uint32_t    size()  const { return static_cast<uint32_t>(offsets_.size()); }
+	//! Returns whether the batch is empty.
+	bool        empty() const { return offsets_.empty(); }
+	//! Returns the number of bytes used for storing the rules.
+	std::size_t bytes() const { return top_; }
+
+	/*!
+	 * \name Update functions
+	 * Functions for appending a rule to the batch.
+	 */
+	//@{
+	RuleBatch& add(Head_t ht, const AtomSpan& head, const LitSpan& body);
+	RuleBatch& add(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& body);
+	RuleBatch& add(const Rule_t& rule);
+	RuleBatch& addMinimize(Weight_t prio, const WeightLitSpan& lits);
+	//! Appends the active rule of the given builder, which can also be a minimize rule.
+	RuleBatch& add(const RuleBuilder& rb);
+	//@}
+	//! Removes all rules from the batch but keeps its memory.
+	RuleBatch& clear();
+
+	//! Returns the i-th rule of the batch.
+	/*!
+	 * For a minimize rule, the returned rule has an empty head and a sum body whose
+	 * bound is the priority of the minimize rule.
+	 * \note The result is only valid until the next call to an update function.
+	 */
+	Rule_t rule(uint32_t i)       const;
+	//! Returns whether the i-th rule is a minimize rule.
+	bool   isMinimize(uint32_t i) const;
+	//! Passes all rules of the batch to out in one call to AbstractProgram::rules().
+	void   emit(AbstractProgram& out) const;
+private:
+	struct Header;
+	RuleBatch(const RuleBatch&);
+	RuleBatch& operator=(const RuleBatch&);
+	Header* header(uint32_t i) const;
+	void*   push(Header h, std::size_t bytes);
+	typedef std::vector<std::size_t> OffsetVec;
+	MemoryRegion mem_;
+	std::size_t  top_;
+	OffsetVec    offsets_;
+};
 ///@}
 
 } // namespace Potassco
@@ -24,7 +24,9 @@
 #ifndef POTASSCO_SMODELS_H_INCLUDED
 #define POTASSCO_SMODELS_H_INCLUDED
 #include <potassco/match_basic_types.h>
+#include <vector>
 namespace Potassco {
+class Arena;
 /*!
  * \addtogroup ParseType
  */
@@ -45,7 +47,7 @@ class SmodelsInput : public ProgramReader {
 public:
 	//! Options for configuring reading of smodels format.
 	struct Options {
-		Options() : claspExt(false), cEdge(false), cHeuristic(false), filter(false) {}
+		Options() : claspExt(false), cEdge(false), cHeuristic(false), filter(false), threads(1) {}
 		//! Enable clasp extensions for handling incremental programs.
 		Options& enableClaspExt() { claspExt = true; return *this; }
 		//! Convert _edge/_acyc_ atoms to edge directives.
@@ -54,10 +56,19 @@ public:
 		Options& convertHeuristic() { cHeuristic = true; return *this; }
 		//! Remove converted atoms from output.
 		Options& dropConverted() { filter = true; return *this; }
-		bool claspExt;
-		bool cEdge;
-		bool cHeuristic;
-		bool filter;
+		//! Use up to n threads for processing the symbol table of a step (0 = one per hardware thread).
+		/*!
+		 * If n is not 1, the symbol table of a step is first read as a whole and then
+		 * classified and hashed in parallel. The resulting callbacks are still issued
+		 * in the order of the symbol table.
+		 * \note If the library was built without thread support, the value is ignored.
+		 */
+		Options& symbolThreads(unsigned n) { threads = n; return *this; }
+		bool     claspExt;
+		bool     cEdge;
+		bool     cHeuristic;
+		bool     filter;
+		unsigned threads;
 	};
 	//! Creates a new parser object that calls out on each parsed element.
 	SmodelsInput(AbstractProgram& out, const Options& opts, AtomTable* symTab = 0);
@@ -84,8 +95,13 @@ protected:
 private:
 	struct NodeTab;
 	struct SymTab;
+	struct Symbol;
+	struct ClassifySymbols;
+	typedef std::vector<Symbol> SymbolVec;
 	void matchBody(RuleBuilder& rule);
 	void matchSum(RuleBuilder& rule, bool weights);
+	bool matchSymbol(Symbol& sym, std::string& temp);
+	void addSymbol(const Symbol& sym, Arena& mem, SymbolVec& doms);
 	AbstractProgram& out_;
 	AtomTable*       atoms_;
 	NodeTab*         nodes_;
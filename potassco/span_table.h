@@ -0,0 +1,203 @@
+//
+// Copyright (c) 2016-2017 Benjamin Kaufmann
+//
+// This file is part of Potassco.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+#ifndef POTASSCO_SPAN_TABLE_H_INCLUDED
+#define POTASSCO_SPAN_TABLE_H_INCLUDED
+#include <potassco/basic_types.h>
+#include <potassco/arena.h>
+#include <cstring>
+#include <algorithm>
+namespace Potassco {
+/*!
+ * \addtogroup BasicTypes
+ */
+///@{
+
+//! Returns a 32-bit hash value for the given byte sequence.
+inline uint32_t hashBytes(const void* data, std::size_t len, uint32_t seed = 0) {
+	// MurmurHash3 (x86_32) by Austin Appleby (public domain).
+	const uint32_t c1 = 0xcc9e2d51u, c2 = 0x1b873593u;
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	uint32_t h = seed, k;
+	for (std::size_t n = len >> 2; n--; p += 4) {
+		std::memcpy(&k, p, 4);
+		k *= c1; k = (k << 15) | (k >> 17); k *= c2;
+		h ^= k;  h = (h << 13) | (h >> 19); h = h * 5 + 0xe6546b64u;
+	}
+	k = 0;
+	switch (len & 3u) {
+		case 3: k ^= static_cast<uint32_t>(p[2]) << 16; // fall through
+		case 2: k ^= static_cast<uint32_t>(p[1]) << 8;  // fall through
+		case 1: k ^= p[0];
+			k *= c1; k = (k << 15) | (k >> 17); k *= c2; h ^= k;
+		default: break;
+	}
+	h ^= static_cast<uint32_t>(len);
+	h ^= h >> 16; h *= 0x85ebca6bu;
+	h ^= h >> 13; h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+//! An open-addressing hash table that maps spans of (trivially copyable) objects to ids.
+/*!
+ * Keys are copied into an internal arena on insertion. The copied keys are
+ * zero-terminated and stay valid (and at the same address) until the table is
+ * cleared or destroyed, while pointers to entries are invalidated by insertions.
+ *
+ * \tparam T The element type of keys. T must be a POD type.
+ */
+template <class T>
+class SpanTable {
+public:
+	typedef Span<T> KeyType;
+	//! Type of table entries.
+	struct Entry {
+		//! Returns the (copied) key of this entry.
+		KeyType  key()  const { return toSpan(data, size); }
+		const T* data;  //!< Zero-terminated copy of the key.
+		uint32_t size;  //!< Number of elements in key.
+		uint32_t hash;  //!< Hash value of key.
+		Id_t     value; //!< Value associated with key.
+	};
+	typedef std::pair<Entry*, bool> InsertResult;
+
+	//! Creates an empty table that obtains its memory from the given allocator.
+	/*!
+	 * If keyAlign is given, it shall be a power of two. Copied keys are then aligned
+	 * to (at least) keyAlign bytes and zero-padded to a multiple of keyAlign bytes.
+	 */
+	explicit SpanTable(Allocator* alloc = 0, std::size_t keyAlign = 0)
+		: table_(0), cap_(0), size_(0), align_(std::max(keyAlign, Arena::alignOf<T>())), keys_(Arena::DEFAULT_BLOCK_SIZE, alloc) {}
+	~SpanTable() { freeTable(); }
+
+	//! Returns the number of keys in the table.
+	uint32_t size()  const { return size_; }
+	//! Returns whether the table is empty.
+	bool     empty() const { return size_ == 0; }
+	//! Returns the number of bytes currently allocated for entries and keys.
+	std::size_t bytes() const { return (cap_ * sizeof(Entry)) + keys_.capacity(); }
+
+	//! Returns the hash value used for the given key.
+	static uint32_t hash(const KeyType& key) { return hashBytes(key.first, key.size * sizeof(T)); }
+
+	//! Returns the entry for the given key or 0 if the key is not in the table.
+	const Entry* find(const KeyType& key) const { return find(key, hash(key)); }
+	//! Same as find(key) but uses the given (precomputed) hash value.
+	/*!
+	 * \pre h == hash(key)
+	 */
+	const Entry* find(const KeyType& key, uint32_t h) const {
+		if (!table_) { return 0; }
+		const Entry* e = table_ + probe(key, h);
+		return e->data ? e : 0;
+	}
+	//! Inserts key with the given value unless key is already in the table.
+	/*!
+	 * \return A pair consisting of the entry for key and a flag indicating
+	 *         whether the key was newly inserted.
+	 * \note If the key was already present, its value is not changed.
+	 */
+	InsertResult insert(const KeyType& key, Id_t value) { return insert(key, hash(key), value); }
+	//! Same as insert(key, value) but uses the given (precomputed) hash value.
+	/*!
+	 * \pre h == hash(key)
+	 */
+	InsertResult insert(const KeyType& key, uint32_t h, Id_t value) {
+		if ((size_ + 1) * 4 > cap_ * 3) { rehash(cap_ ? cap_ * 2 : 16); }
+		Entry* e = table_ + probe(key, h);
+		if (e->data) { return InsertResult(e, false); }
+		e->data  = copyKey(key);
+		e->size  = static_cast<uint32_t>(key.size);
+		e->hash  = h;
+		e->value = value;
+		++size_;
+		return InsertResult(e, true);
+	}
+	//! Calls f(e) for each entry e in the table (in unspecified order).
+	template <class F>
+	void forEach(F& f) const {
+		for (const Entry* it = table_, *end = table_ + cap_; it != end; ++it) {
+			if (it->data) { f(*it); }
+		}
+	}
+	//! Removes all keys from the table and releases all memory.
+	void clear() {
+		freeTable();
+		table_ = 0;
+		cap_ = size_ = 0;
+		keys_.release();
+	}
+	//! Swaps this and other.
+	void swap(SpanTable& other) {
+		std::swap(table_, other.table_);
+		std::swap(cap_, other.cap_);
+		std::swap(size_, other.size_);
+		std::swap(align_, other.align_);
+		keys_.swap(other.keys_);
+	}
+private:
+	SpanTable(const SpanTable&);
+	SpanTable& operator=(const SpanTable&);
+	static bool equal(const Entry& e, const KeyType& key, uint32_t h) {
+		return e.hash == h && e.size == key.size && std::memcmp(e.data, key.first, key.size * sizeof(T)) == 0;
+	}
+	// Returns the slot for key, which is either the slot containing key or the first free slot.
+	uint32_t probe(const KeyType& key, uint32_t h) const {
+		const uint32_t mask = cap_ - 1;
+		for (uint32_t i = h & mask;; i = (i + 1) & mask) {
+			if (!table_[i].data || equal(table_[i], key, h)) { return i; }
+		}
+	}
+	const T* copyKey(const KeyType& key) {
+		std::size_t n = key.size * sizeof(T), nb = (n + sizeof(T) + align_ - 1) & ~(align_ - 1);
+		unsigned char* r = static_cast<unsigned char*>(keys_.allocate(nb, align_));
+		if (n) { std::memcpy(r, key.first, n); }
+		std::memset(r + n, 0, nb - n);
+		return reinterpret_cast<const T*>(r);
+	}
+	void freeTable() {
+		if (table_) { keys_.allocator().deallocate(table_, cap_ * sizeof(Entry)); }
+	}
+	void rehash(uint32_t nc) {
+		Entry* t = static_cast<Entry*>(keys_.allocator().allocate(nc * sizeof(Entry)));
+		std::memset(t, 0, nc * sizeof(Entry));
+		for (const Entry* it = table_, *end = table_ + cap_; it != end; ++it) {
+			if (!it->data) { continue; }
+			uint32_t i = it->hash & (nc - 1);
+			while (t[i].data) { i = (i + 1) & (nc - 1); }
+			t[i] = *it;
+		}
+		freeTable();
+		table_ = t;
+		cap_   = nc;
+	}
+	Entry*      table_;
+	uint32_t    cap_;
+	uint32_t    size_;
+	std::size_t align_;
+	Arena       keys_;
+};
+///@}
+} // namespace Potassco
+#endif
@@ -25,6 +25,7 @@
 #define POTASSCO_THEORY_DATA_H_INCLUDED
 
 #include <potassco/basic_types.h>
+#include <iosfwd>
 #include <iterator>
 #include <utility>
 #include <new>
@@ -112,10 +113,13 @@ class TheoryElement {
 public:
 	//! Iterator type for iterating over the terms of an element.
 	typedef const Id_t* iterator;
-	//! Creates a new TheoryElement over the given terms.
-	static TheoryElement* newElement(const IdSpan& terms, Id_t condition);
+	//! Creates a new TheoryElement over the given terms with memory from alloc (or mallocAllocator() if alloc is 0).
+	static TheoryElement* newElement(const IdSpan& terms, Id_t condition, Allocator* alloc = 0);
 	//! Destroys the given TheoryElement.
-	static void destroy(TheoryElement* a);
+	/*!
+	 * \pre a was created by newElement() with the same allocator.
+	 */
+	static void destroy(TheoryElement* a, Allocator* alloc = 0);
 	//! Returns the number of terms belonging to this element.
 	uint32_t size()  const { return nTerms_; }
 	//! Returns an iterator pointing to the first term of this element.
@@ -144,12 +148,15 @@ class TheoryAtom {
 public:
 	//! Iterator type for iterating over the elements of a theory atom.
 	typedef const Id_t* iterator;
-	//! Creates a new theory atom.
-	static TheoryAtom* newAtom(Id_t atom, Id_t term, const IdSpan& elements);
-	//! Creates a new theory atom with guard.
-	static TheoryAtom* newAtom(Id_t atom, Id_t term, const IdSpan& elements, Id_t op, Id_t rhs);
+	//! Creates a new theory atom with memory from alloc (or mallocAllocator() if alloc is 0).
+	static TheoryAtom* newAtom(Id_t atom, Id_t term, const IdSpan& elements, Allocator* alloc = 0);
+	//! Creates a new theory atom with guard with memory from alloc (or mallocAllocator() if alloc is 0).
+	static TheoryAtom* newAtom(Id_t atom, Id_t term, const IdSpan& elements, Id_t op, Id_t rhs, Allocator* alloc = 0);
 	//! Destroys the given theory atom.
-	static void  destroy(TheoryAtom* a);
+	/*!
+	 * \pre a was created by newAtom() with the same allocator.
+	 */
+	static void  destroy(TheoryAtom* a, Allocator* alloc = 0);
 
 	//! Returns the associated program atom or 0 if this originated from a directive.
 	Id_t       atom()       const { return static_cast<Id_t>(atom_); }
@@ -168,6 +175,7 @@ public:
 	//! Returns a pointer to the term id of the right hand side of the theory operator or 0 if atom has no guard.
 	const Id_t* rhs()       const;
 private:
+	friend class TheoryData;
 	TheoryAtom(Id_t atom, Id_t term, const IdSpan& elements, Id_t* op, Id_t* rhs);
 	TheoryAtom(const TheoryAtom&);
 	TheoryAtom& operator=(const TheoryAtom&);
@@ -181,13 +189,23 @@ POTASSCO_WARNING_END_RELAXED
 };
 
 //! A type for storing and looking up theory atoms and their elements and terms.
+/*!
+ * Terms and elements are indexed by id. Ids need not be dense: memory for the index
+ * of large or sparse ids is allocated in pages on first use.
+ */
 class TheoryData {
 public:
 	//! Iterator type for iterating over the theory atoms of a TheoryData object.
 	typedef const TheoryAtom*const* atom_iterator;
 	typedef TheoryTerm    Term;
 	typedef TheoryElement Element;
-	TheoryData();
+	//! Creates an empty object that obtains memory for atoms, elements, and terms from alloc.
+	/*!
+	 * Atoms, elements, and compound terms are carved from large blocks that are
+	 * only returned to alloc on reset() or destruction. Hence, memory of removed or
+	 * redefined objects is not reclaimed before the next call to reset().
+	 */
+	explicit TheoryData(Allocator* alloc = 0);
 	~TheoryData();
 	//! Sentinel for marking a condition to be set later.
 	static const Id_t COND_DEFERRED = static_cast<Id_t>(-1);
@@ -222,6 +240,11 @@ public:
 	//! Adds a new number term with the given id.
 	const TheoryTerm& addTerm(Id_t termId, int number);
 	//! Adds a new symbolic term with the given name and id.
+	/*!
+	 * Names are interned, i.e. all symbolic terms with the same name refer to the same
+	 * string. Hence, symbolic terms can be compared by comparing their symbol() pointers.
+	 * Interned names are only released on reset().
+	 */
 	const TheoryTerm& addTerm(Id_t termId, const StringSpan& name);
 	//! Adds a new symbolic term with the given name and id.
 	const TheoryTerm& addTerm(Id_t termId, const char* name);
@@ -234,6 +257,28 @@ public:
 	//! Adds a new tuple term with the given id.
 	const TheoryTerm& addTerm(Id_t termId, Tuple_t type, const IdSpan& args);
 
+	//! Enables or disables hash-consing of terms and elements.
+	/*!
+	 * If enabled, a term that is structurally equal to an existing term, i.e. has the same type and
+	 * number, name, or functor and argument ids, shares the storage of the existing term.
+	 * Similarly, elements with the same term ids and condition share storage.
+	 * Elements added with condition COND_DEFERRED are never shared.
+	 *
+	 * The setting is kept on reset(). Disabling sharing drops all canonical id information.
+	 */
+	void setSharing(bool on);
+	//! Returns whether hash-consing of terms and elements is enabled.
+	bool sharing() const;
+	//! Returns the id of the first term that is structurally equal to the term with the given id.
+	/*!
+	 * If sharing is disabled or the term has no earlier duplicate, t is returned.
+	 * \note If the representative of a set of duplicates is removed, the remaining
+	 *       terms of that set become their own representatives.
+	 */
+	Id_t canonicalTerm(Id_t t) const;
+	//! Returns the id of the first element that is structurally equal to the element with the given id.
+	Id_t canonicalElement(Id_t e) const;
+
 	//! Removes the term with the given id.
 	/*!
 	 * \note It is the caller's responsibility to ensure that the removed term is not referenced
@@ -262,6 +307,31 @@ public:
 	const Term&    getTerm(Id_t t)      const;
 	//! Returns the element with the given id or throws if no such element exists.
 	const Element& getElement(Id_t e)   const;
+	//! Returns the interned copy of the given name or 0 if no symbolic term with that name was added since the last reset().
+	const char*    findSymbol(const char* name) const;
+	//! Returns a value that changes whenever a term is removed or this object is reset.
+	/*!
+	 * The value can be used to check whether information derived from the terms
+	 * of this object is still valid. Values are unique among all TheoryData objects
+	 * of a process, i.e. two different objects never return the same value.
+	 */
+	uint32_t       termVersion()        const;
+
+	//! Writes a binary snapshot of this object to out.
+	/*!
+	 * The snapshot is a sequence of 32-bit words in host byte order that
+	 * stores all terms, elements, and atoms together with the step boundary
+	 * established by the last call to update().
+	 */
+	void save(std::ostream& out) const;
+	//! Replaces the content of this object with the snapshot stored in the given memory block.
+	/*!
+	 * The block shall contain a snapshot previously written by save() on a host with the
+	 * same byte order. It is only read during the call and may hence be a memory mapped file.
+	 * \throw std::runtime_error if the block does not contain a valid snapshot.
+	 *        In that case, the object may contain a prefix of the snapshot.
+	 */
+	void load(const void* snapshot, std::size_t bytes);
 
 	//! Removes all theory atoms a for which f(a) returns true.
 	template <class F>
@@ -275,7 +345,6 @@ public:
 			}
 			else {
 				++pop;
-				TheoryAtom::destroy(const_cast<TheoryAtom*>(*it));
 			}
 		}
 		resizeAtoms(numAtoms() - pop);
@@ -299,6 +368,21 @@ public:
 	enum VisitMode { visit_all , visit_current };
 	//! Calls out.visit(*this, a) for all theory atoms.
 	void accept(Visitor& out, VisitMode m = visit_current) const;
+	//! Visits the theory atoms in parallel.
+	/*!
+	 * Splits the theory atoms into workers.size consecutive ranges and calls
+	 * workers[i]->visit(*this, a) for each atom a in the i-th range, where ranges are
+	 * processed concurrently by separate threads. Returns once all atoms were visited.
+	 * If a visitor throws an exception, the first such exception is rethrown once
+	 * all workers have finished.
+	 *
+	 * \note During the traversal, the visitors may call any const member function of
+	 *       this object concurrently, but must neither modify this object nor share
+	 *       mutable state among each other without synchronization.
+	 * \note If the library was built without thread support, ranges are visited
+	 *       sequentially on the calling thread.
+	 */
+	void accept(const Span<Visitor*>& workers, VisitMode m = visit_current) const;
 	//! Visits terms and elements of a.
 	void accept(const TheoryAtom& a, Visitor& out, VisitMode m = visit_all) const;
 	//! Visits terms of e.
@@ -308,10 +392,8 @@ public:
 private:
 	TheoryData(const TheoryData&);
 	TheoryData& operator=(const TheoryData&);
-	struct DestroyT;
 	TheoryTerm&     setTerm(Id_t);
-	TheoryTerm*     terms()    const;
-	TheoryElement** elems()    const;
+	const TheoryTerm& addCompound(Id_t termId, int32_t base, const IdSpan& args);
 	TheoryAtom**    atoms()    const;
 	uint32_t        numTerms() const;
 	uint32_t        numElems() const;
@@ -0,0 +1,180 @@
+//
+// Copyright (c) 2016-2017 Benjamin Kaufmann
+//
+// This file is part of Potassco.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+#include <potassco/arena.h>
+#include <algorithm>
+#include <cstring>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+namespace Potassco {
+/////////////////////////////////////////////////////////////////////////////////////////
+// Allocator
+/////////////////////////////////////////////////////////////////////////////////////////
+Allocator::~Allocator() {}
+void* Allocator::reallocate(void* p, std::size_t n, std::size_t nn) {
+	void* t = allocate(nn);
+	if (p) {
+		std::memcpy(t, p, std::min(n, nn));
+		deallocate(p, n);
+	}
+	return t;
+}
+namespace {
+struct MallocAllocator : Allocator {
+	virtual void* allocate(std::size_t n) {
+		void* t = std::malloc(n ? n : 1);
+		POTASSCO_CHECK(t, ENOMEM);
+		return t;
+	}
+	virtual void deallocate(void* p, std::size_t) { std::free(p); }
+	virtual void* reallocate(void* p, std::size_t, std::size_t nn) {
+		void* t = std::realloc(p, nn ? nn : 1);
+		POTASSCO_CHECK(t, ENOMEM);
+		return t;
+	}
+};
+}
+Allocator& mallocAllocator() {
+	static MallocAllocator alloc;
+	return alloc;
+}
+/////////////////////////////////////////////////////////////////////////////////////////
+// Arena
+/////////////////////////////////////////////////////////////////////////////////////////
+struct Arena::Block {
+	Block*      next;
+	std::size_t size;
+};
+Arena::Arena(std::size_t blockSize, Allocator* alloc) : alloc_(&allocatorOrDefault(alloc)), head_(0), pos_(0), end_(0), block_(blockSize), cap_(0) {}
+Arena::~Arena() { release(); }
+void Arena::release() {
+	for (Block* b; (b = head_) != 0;) {
+		head_ = b->next;
+		alloc_->deallocate(b, b->size);
+	}
+	pos_ = end_ = 0;
+	cap_ = 0;
+}
+void Arena::swap(Arena& other) {
+	std::swap(alloc_, other.alloc_);
+	std::swap(head_, other.head_);
+	std::swap(pos_, other.pos_);
+	std::swap(end_, other.end_);
+	std::swap(block_, other.block_);
+	std::swap(cap_, other.cap_);
+}
+static char* alignUp(char* p, std::size_t align) {
+	return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p) + (align - 1)) & ~static_cast<uintptr_t>(align - 1));
+}
+void* Arena::allocate(std::size_t n, std::size_t align) {
+	assert(align && (align & (align - 1)) == 0);
+	char* p = alignUp(pos_, align);
+	if (pos_ && p <= end_ && static_cast<std::size_t>(end_ - p) >= n) {
+		pos_ = p + n;
+		return p;
+	}
+	return allocBlock(n, align);
+}
+bool Arena::extend(void* p, std::size_t n, std::size_t nn) {
+	char* x = static_cast<char*>(p);
+	if (x && x + n == pos_ && static_cast<std::size_t>(end_ - x) >= nn) {
+		pos_ = x + nn;
+		return true;
+	}
+	return false;
+}
+void* Arena::allocBlock(std::size_t n, std::size_t align) {
+	std::size_t hdr = (sizeof(Block) + (align - 1)) & ~(align - 1);
+	std::size_t sz  = hdr + n;
+	bool large = sz > block_ / 2;
+	if (!large) { sz = block_; }
+	Block* b = static_cast<Block*>(alloc_->allocate(sz));
+	b->size = sz;
+	cap_   += sz;
+	char* r = reinterpret_cast<char*>(b) + hdr;
+	if (large && head_) {
+		// keep current block for subsequent small allocations
+		b->next = head_->next;
+		head_->next = b;
+	}
+	else {
+		b->next = head_;
+		head_   = b;
+		pos_    = r + n;
+		end_    = reinterpret_cast<char*>(b) + sz;
+	}
+	return r;
+}
+/////////////////////////////////////////////////////////////////////////////////////////
+// ArenaAllocator
+/////////////////////////////////////////////////////////////////////////////////////////
+ArenaAllocator::ArenaAllocator(std::size_t blockSize, Allocator* upstream) : arena_(blockSize, upstream) {}
+void* ArenaAllocator::allocate(std::size_t n) { return arena_.allocate(n, ALIGN); }
+void  ArenaAllocator::deallocate(void*, std::size_t) {}
+void* ArenaAllocator::reallocate(void* p, std::size_t n, std::size_t nn) {
+	return arena_.extend(p, n, nn) ? p : Allocator::reallocate(p, n, nn);
+}
+/////////////////////////////////////////////////////////////////////////////////////////
+// HugePageAllocator
+/////////////////////////////////////////////////////////////////////////////////////////
+static std::size_t hugeRound(std::size_t n) {
+	return (n + (HugePageAllocator::HUGE_PAGE_SIZE - 1)) & ~static_cast<std::size_t>(HugePageAllocator::HUGE_PAGE_SIZE - 1);
+}
+HugePageAllocator::HugePageAllocator(std::size_t threshold) : threshold_(threshold) {}
+bool HugePageAllocator::supported() {
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	return true;
+#else
+	return false;
+#endif
+}
+bool HugePageAllocator::mapped(std::size_t n) const {
+	return supported() && n >= threshold_;
+}
+void* HugePageAllocator::allocate(std::size_t n) {
+	if (!mapped(n)) { return mallocAllocator().allocate(n); }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	std::size_t sz = hugeRound(n);
+	void* t = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	POTASSCO_CHECK(t != MAP_FAILED, ENOMEM);
+	madvise(t, sz, MADV_HUGEPAGE);
+	return t;
+#else
+	return 0;
+#endif
+}
+void HugePageAllocator::deallocate(void* p, std::size_t n) {
+	if (!p) { return; }
+	if (!mapped(n)) { return mallocAllocator().deallocate(p, n); }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	munmap(p, hugeRound(n));
+#endif
+}
+void* HugePageAllocator::reallocate(void* p, std::size_t n, std::size_t nn) {
+	if (!p) { return allocate(nn); }
+	if (!mapped(n) && !mapped(nn)) { return mallocAllocator().reallocate(p, n, nn); }
+	if (mapped(n) && mapped(nn) && hugeRound(n) == hugeRound(nn)) { return p; }
+	return Allocator::reallocate(p, n, nn);
+}
+} // namespace Potassco
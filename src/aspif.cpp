@@ -29,6 +29,7 @@
 #include <string>
 #include <cstring>
 #include <functional>
+#include <algorithm>
 #if defined(_MSC_VER)
 #pragma warning (disable : 4996)
 #endif
@@ -125,15 +126,20 @@ bool AspifInput::doParse() {
 	return true;
 }
 
+// Bounds reserve hints so that malformed sizes do not trigger huge allocations.
+static uint32_t reserveHint(uint32_t len) { return std::min(len, uint32_t(1) << 20); }
 void AspifInput::matchAtoms() {
-	for (uint32_t len = matchPos("number of atoms expected"); len--;) { rule_->addHead(matchAtom()); }
+	uint32_t len = matchPos("number of atoms expected");
+	for (rule_->reserve(reserveHint(len), 0); len--;) { rule_->addHead(matchAtom()); }
 }
 void AspifInput::matchLits() {
 	rule_->startBody();
-	for (uint32_t len = matchPos("number of literals expected"); len--;) { rule_->addGoal(matchLit()); }
+	uint32_t len = matchPos("number of literals expected");
+	for (rule_->reserve(0, reserveHint(len)); len--;) { rule_->addGoal(matchLit()); }
 }
 void AspifInput::matchWLits(int32_t minW) {
-	for (uint32_t len = matchPos("number of literals expected"); len--;) { rule_->addGoal(matchWLit(minW)); }
+	uint32_t len = matchPos("number of literals expected");
+	for (rule_->reserve(0, reserveHint(len)); len--;) { rule_->addGoal(matchWLit(minW)); }
 }
 void AspifInput::matchString() {
 	uint32_t len = matchPos("non-negative string length expected");
@@ -251,6 +257,15 @@ void AspifOutput::rule(Head_t ht, const AtomSpan& head, Weight_t bound, const We
 void AspifOutput::minimize(Weight_t prio, const WeightLitSpan& lits) {
 	startDir(Directive_t::Minimize).add(prio).add(lits).endDir();
 }
+void AspifOutput::rules(const RuleBatch& batch) {
+	// dispatch statically instead of once per rule through the virtual interface
+	for (uint32_t i = 0, end = batch.size(); i != end; ++i) {
+		Rule_t r = batch.rule(i);
+		if      (batch.isMinimize(i)) { AspifOutput::minimize(r.agg.bound, r.agg.lits); }
+		else if (r.normal())          { AspifOutput::rule(r.ht, r.head, r.cond); }
+		else                          { AspifOutput::rule(r.ht, r.head, r.agg.bound, r.agg.lits); }
+	}
+}
 void AspifOutput::output(const StringSpan& str, const LitSpan& cond) {
 	startDir(Directive_t::Output).add(str).add(cond).endDir();
 }
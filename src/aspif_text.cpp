@@ -24,9 +24,12 @@
 #include <potassco/aspif_text.h>
 #include <potassco/string_convert.h>
 #include <potassco/rule_utils.h>
+#include <potassco/paged_map.h>
+#include "parallel.h"
 #include <cctype>
 #include <cstring>
 #include <ostream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <cassert>
@@ -298,9 +301,10 @@ void AspifTextInput::matchStr() {
 /////////////////////////////////////////////////////////////////////////////////////////
 struct AspifTextOutput::Data {
 	typedef std::vector<std::string> StringVec;
-	typedef std::vector<Id_t> AtomMap;
+	typedef PagedMap<Id_t> AtomMap;
 	typedef std::vector<Lit_t> LitVec;
 	typedef std::vector<uint32_t> RawVec;
+	explicit Data(Allocator* alloc) : atoms(idMax, alloc) {}
 	LitSpan getCondition(Id_t id) const {
 		return toSpan(&conditions[id + 1], static_cast<size_t>(conditions[id]));
 	}
@@ -318,27 +322,44 @@ struct AspifTextOutput::Data {
 		return id;
 	}
 	RawVec    directives;
+	RawVec    starts; // start positions of directives
 	StringVec strings;
 	AtomMap   atoms; // maps into strings
 	LitVec    conditions;
-	uint32_t  readPos;
-	void reset() { directives.clear();  strings.clear(); atoms.clear(); conditions.clear(); readPos = 0; }
+	void reset() { directives.clear(); starts.clear(); strings.clear(); atoms.clear(); conditions.clear(); }
 };
-AspifTextOutput::AspifTextOutput(std::ostream& os) : os_(os), step_(-1) {
-	data_ = new Data();
+// Renders a part of the directives of a step into a separate buffer.
+struct AspifTextOutput::Render {
+	// Minimal number of directives per buffer.
+	enum { MIN_DIRECTIVES = 1024 };
+	Render(const AspifTextOutput& s, unsigned n) : self(&s), buffers(n) {}
+	void operator()(unsigned i) {
+		const Data::RawVec& starts = self->data_->starts;
+		std::size_t n = buffers.size(), b = (starts.size() * i) / n, e = (starts.size() * (i + 1)) / n;
+		std::ostringstream str;
+		self->writeDirectives(str, starts[b], e != starts.size() ? starts[e] : static_cast<uint32_t>(self->data_->directives.size()));
+		buffers[i] = str.str();
+	}
+	const AspifTextOutput*   self;
+	std::vector<std::string> buffers;
+};
+AspifTextOutput::AspifTextOutput(std::ostream& os, Allocator* alloc) : os_(os), theory_(alloc), step_(-1), threads_(1) {
+	data_ = new Data(alloc);
+}
+void AspifTextOutput::setThreads(unsigned n) {
+	threads_ = n;
 }
 AspifTextOutput::~AspifTextOutput() {
 	delete data_;
 }
 void AspifTextOutput::addAtom(Atom_t id, const StringSpan& str) {
-	if (id >= data_->atoms.size()) { data_->atoms.resize(id + 1, idMax); }
 	data_->atoms[id] = data_->addString(str);
 }
 std::ostream& AspifTextOutput::printName(std::ostream& os, Lit_t lit) const {
 	if (lit < 0) { os << "not "; }
 	Atom_t id = Potassco::atom(lit);
-	if (id < data_->atoms.size() && data_->atoms[id] < data_->strings.size()) {
-		os << data_->strings[data_->atoms[id]];
+	if (data_->atoms.get(id) < data_->strings.size()) {
+		os << data_->strings[data_->atoms.get(id)];
 	}
 	else {
 		os << "x_" << id;
@@ -357,13 +378,13 @@ void AspifTextOutput::beginStep() {
 	}
 }
 void AspifTextOutput::rule(Head_t ht, const AtomSpan& head, const LitSpan& body) {
-	push(Directive_t::Rule).push(static_cast<uint32_t>(ht)).push(head).push(Body_t::Normal).push(body);
+	startDir(Directive_t::Rule).push(static_cast<uint32_t>(ht)).push(head).push(Body_t::Normal).push(body);
 }
 void AspifTextOutput::rule(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& lits) {
 	if (size(lits) == 0) {
 		AspifTextOutput::rule(ht, head, toSpan<Lit_t>());
 	}
-	push(Directive_t::Rule).push(static_cast<uint32_t>(ht)).push(head);
+	startDir(Directive_t::Rule).push(static_cast<uint32_t>(ht)).push(head);
 	uint32_t top = static_cast<uint32_t>(data_->directives.size());
 	Weight_t min = weight(*begin(lits)), max = min;
 	push(Body_t::Sum).push(bound).push(static_cast<uint32_t>(size(lits)));
@@ -382,7 +403,7 @@ void AspifTextOutput::rule(Head_t ht, const AtomSpan& head, Weight_t bound, cons
 	}
 }
 void AspifTextOutput::minimize(Weight_t prio, const WeightLitSpan& lits) {
-	push(Directive_t::Minimize).push(lits).push(prio);
+	startDir(Directive_t::Minimize).push(lits).push(prio);
 }
 void AspifTextOutput::output(const StringSpan& str, const LitSpan& cond) {
 	bool isAtom = size(str) > 0 && (std::islower(static_cast<unsigned char>(*begin(str))) || *begin(str) == '_');
@@ -390,23 +411,23 @@ void AspifTextOutput::output(const StringSpan& str, const LitSpan& cond) {
 		addAtom(Potassco::atom(*begin(cond)), str);
 	}
 	else {
-		push(Directive_t::Output).push(data_->addString(str)).push(cond);
+		startDir(Directive_t::Output).push(data_->addString(str)).push(cond);
 	}
 }
 void AspifTextOutput::external(Atom_t a, Value_t v) {
-	push(Directive_t::External).push(a).push(static_cast<uint32_t>(v));
+	startDir(Directive_t::External).push(a).push(static_cast<uint32_t>(v));
 }
 void AspifTextOutput::assume(const LitSpan& lits) {
-	push(Directive_t::Assume).push(lits);
+	startDir(Directive_t::Assume).push(lits);
 }
 void AspifTextOutput::project(const AtomSpan& atoms) {
-	push(Directive_t::Project).push(atoms);
+	startDir(Directive_t::Project).push(atoms);
 }
 void AspifTextOutput::acycEdge(int s, int t, const LitSpan& condition) {
-	push(Directive_t::Edge).push(s).push(t).push(condition);
+	startDir(Directive_t::Edge).push(s).push(t).push(condition);
 }
 void AspifTextOutput::heuristic(Atom_t a, Heuristic_t t, int bias, unsigned prio, const LitSpan& condition) {
-	push(Directive_t::Heuristic).push(a).push(condition).push(bias).push(prio).push(static_cast<uint32_t>(t));
+	startDir(Directive_t::Heuristic).push(a).push(condition).push(bias).push(prio).push(static_cast<uint32_t>(t));
 }
 void AspifTextOutput::theoryTerm(Id_t termId, int number) {
 	theory_.addTerm(termId, number);
@@ -427,8 +448,12 @@ void AspifTextOutput::theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& ele
 	theory_.addAtom(atomOrZero, termId, elements, op, rhs);
 }
 template <class T>
-T AspifTextOutput::get() {
-	return static_cast<T>(data_->directives[data_->readPos++]);
+T AspifTextOutput::get(uint32_t& pos) const {
+	return static_cast<T>(data_->directives[pos++]);
+}
+AspifTextOutput& AspifTextOutput::startDir(Directive_t d) {
+	data_->starts.push_back(static_cast<uint32_t>(data_->directives.size()));
+	return push(static_cast<uint32_t>(d));
 }
 AspifTextOutput& AspifTextOutput::push(uint32_t x) {
 	data_->directives.push_back(x);
@@ -454,56 +479,69 @@ AspifTextOutput& AspifTextOutput::push(const WeightLitSpan& wlits) {
 	return *this;
 }
 void AspifTextOutput::writeDirectives() {
+	uint32_t size = static_cast<uint32_t>(data_->directives.size());
+	unsigned n = detail::numThreads(threads_), max = static_cast<unsigned>(data_->starts.size() / Render::MIN_DIRECTIVES);
+	if (n > max) { n = max; }
+	if (n <= 1) {
+		writeDirectives(os_, 0, size);
+		return;
+	}
+	Render render(*this, n);
+	detail::parallelFor(n, render);
+	for (std::vector<std::string>::const_iterator it = render.buffers.begin(), end = render.buffers.end(); it != end; ++it) {
+		os_.write(it->data(), static_cast<std::streamsize>(it->size()));
+	}
+}
+void AspifTextOutput::writeDirectives(std::ostream& os, uint32_t pos, uint32_t end) const {
 	const char* sep = 0, *term = 0;
-	data_->readPos = 0;
-	for (uint32_t x; (x = get<uint32_t>()) != Directive_t::End;) {
+	while (pos != end) {
 		sep = term = "";
-		switch (x) {
+		switch (get<uint32_t>(pos)) {
 			case Directive_t::Rule:
-				if (get<uint32_t>() != 0) { os_ << "{"; term = "}"; }
-				for (uint32_t n = get<uint32_t>(); n--; sep = !*term ? "|" : ";") { printName(os_ << sep, get<Atom_t>()); }
-				if (*sep) { os_ << term; sep = " :- "; }
-				else      { os_ << ":- "; }
+				if (get<uint32_t>(pos) != 0) { os << "{"; term = "}"; }
+				for (uint32_t n = get<uint32_t>(pos); n--; sep = !*term ? "|" : ";") { printName(os << sep, get<Atom_t>(pos)); }
+				if (*sep) { os << term; sep = " :- "; }
+				else      { os << ":- "; }
 				term = ".";
-				switch (uint32_t bt = get<uint32_t>()) {
+				switch (uint32_t bt = get<uint32_t>(pos)) {
 					case Body_t::Normal:
-						for (uint32_t n = get<uint32_t>(); n--; sep = ", ") { printName(os_ << sep, get<Lit_t>()); }
+						for (uint32_t n = get<uint32_t>(pos); n--; sep = ", ") { printName(os << sep, get<Lit_t>(pos)); }
 						break;
 					case Body_t::Count: // fall through
 					case Body_t::Sum:
-						os_ << sep << get<Weight_t>();
+						os << sep << get<Weight_t>(pos);
 						sep = "{";
-						for (uint32_t n = get<uint32_t>(); n--; sep = "; ") {
-							printName(os_ << sep, get<Lit_t>());
-							if (bt == Body_t::Sum) { os_ << "=" << get<Weight_t>(); }
+						for (uint32_t n = get<uint32_t>(pos); n--; sep = "; ") {
+							printName(os << sep, get<Lit_t>(pos));
+							if (bt == Body_t::Sum) { os << "=" << get<Weight_t>(pos); }
 						}
-						os_ << "}";
+						os << "}";
 						break;
 				}
 				break;
 			case Directive_t::Minimize:
 				sep = "#minimize{"; term = ".";
-				for (uint32_t n = get<uint32_t>(); n--; sep = "; ") {
-					printName(os_ << sep, get<Lit_t>());
-					os_ << "=" << get<Weight_t>();
+				for (uint32_t n = get<uint32_t>(pos); n--; sep = "; ") {
+					printName(os << sep, get<Lit_t>(pos));
+					os << "=" << get<Weight_t>(pos);
 				}
-				os_ << "}@" << get<Weight_t>();
+				os << "}@" << get<Weight_t>(pos);
 				break;
 			case Directive_t::Project:
 				sep = "#project{"; term = "}.";
-				for (uint32_t n = get<uint32_t>(); n--; sep = ", ") { printName(os_ << sep, get<Lit_t>()); }
+				for (uint32_t n = get<uint32_t>(pos); n--; sep = ", ") { printName(os << sep, get<Lit_t>(pos)); }
 				break;
 			case Directive_t::Output:
 				sep = " : "; term = ".";
-				os_ << "#show " << data_->strings[get<uint32_t>()];
-				for (uint32_t n = get<uint32_t>(); n--; sep = ", ") {
-					printName(os_ << sep, get<Lit_t>());
+				os << "#show " << data_->strings[get<uint32_t>(pos)];
+				for (uint32_t n = get<uint32_t>(pos); n--; sep = ", ") {
+					printName(os << sep, get<Lit_t>(pos));
 				}
 				break;
 			case Directive_t::External:
 				sep = "#external "; term = ".";
-				printName(os_ << sep, get<Atom_t>());
-				switch (get<uint32_t>()) {
+				printName(os << sep, get<Atom_t>(pos));
+				switch (get<uint32_t>(pos)) {
 					default: break;
 					case Value_t::Free:    term = ". [free]"; break;
 					case Value_t::True:    term = ". [true]"; break;
@@ -512,26 +550,26 @@ void AspifTextOutput::writeDirectives() {
 				break;
 			case Directive_t::Assume:
 				sep = "#assume{"; term = "}.";
-				for (uint32_t n = get<uint32_t>(); n--; sep = ", ") { printName(os_ << sep, get<Lit_t>()); }
+				for (uint32_t n = get<uint32_t>(pos); n--; sep = ", ") { printName(os << sep, get<Lit_t>(pos)); }
 				break;
 			case Directive_t::Heuristic:
 				sep = " : "; term = "";
-				os_ << "#heuristic ";
-				printName(os_, get<Atom_t>());
-				for (uint32_t n = get<uint32_t>(); n--; sep = ", ") { printName(os_ << sep, get<Lit_t>()); }
-				os_ << ". [" << get<int32_t>();
-				if (uint32_t p = get<uint32_t>()) { os_ << "@" << p; }
-				os_ << ", " << toString(static_cast<Heuristic_t>(get<uint32_t>())) << "]";
+				os << "#heuristic ";
+				printName(os, get<Atom_t>(pos));
+				for (uint32_t n = get<uint32_t>(pos); n--; sep = ", ") { printName(os << sep, get<Lit_t>(pos)); }
+				os << ". [" << get<int32_t>(pos);
+				if (uint32_t p = get<uint32_t>(pos)) { os << "@" << p; }
+				os << ", " << toString(static_cast<Heuristic_t>(get<uint32_t>(pos))) << "]";
 				break;
 			case Directive_t::Edge:
 				sep = " : "; term = ".";
-				os_ << "#edge(" << get<int32_t>() << ",";
-				os_ << get<int32_t>() << ")";
-				for (uint32_t n = get<uint32_t>(); n--; sep = ", ") { printName(os_ << sep, get<Lit_t>()); }
+				os << "#edge(" << get<int32_t>(pos) << ",";
+				os << get<int32_t>(pos) << ")";
+				for (uint32_t n = get<uint32_t>(pos); n--; sep = ", ") { printName(os << sep, get<Lit_t>(pos)); }
 				break;
 			default: break;
 		}
-		os_ << term << "\n";
+		os << term << "\n";
 	}
 }
 void AspifTextOutput::visitTheories() {
@@ -541,82 +579,159 @@ void AspifTextOutput::visitTheories() {
 			return self->data_->getCondition(condId);
 		}
 		virtual std::string getName(Atom_t id) const {
-			if (id < self->data_->atoms.size() && self->data_->atoms[id] < self->data_->strings.size()) {
-				return self->data_->strings[self->data_->atoms[id]];
+			if (self->data_->atoms.get(id) < self->data_->strings.size()) {
+				return self->data_->strings[self->data_->atoms.get(id)];
 			}
 			return std::string("x_").append(Potassco::toString(id));
 		}
 		AspifTextOutput* self;
 	} toStr(*this);
+	StringBuilder name;
 	for (TheoryData::atom_iterator it = theory_.currBegin(), end = theory_.end(); it != end; ++it) {
 		Atom_t atom = (*it)->atom();
-		std::string name = toStr.toString(theory_, **it);
+		toStr.toString(theory_, **it, name.clear());
 		if (!atom) {
-			os_ << name << ".\n";
+			os_.write(name.c_str(), static_cast<std::streamsize>(name.size()));
+			os_ << ".\n";
 		}
 		else {
-			POTASSCO_REQUIRE(atom >= data_->atoms.size() || data_->atoms[atom] == idMax,
-				"Redefinition: theory atom '%u' already shown as '%s'", atom, data_->strings[data_->atoms[atom]].c_str());
-			addAtom(atom, toSpan(name));
+			POTASSCO_REQUIRE(data_->atoms.get(atom) == idMax,
+				"Redefinition: theory atom '%u' already shown as '%s'", atom, data_->strings[data_->atoms.get(atom)].c_str());
+			addAtom(atom, name.toSpan());
 		}
 	}
 }
 void AspifTextOutput::endStep() {
 	visitTheories();
-	push(Directive_t::End);
 	writeDirectives();
 	Data::RawVec().swap(data_->directives);
+	Data::RawVec().swap(data_->starts);
 	if (step_ < 0) { theory_.reset(); }
 }
 /////////////////////////////////////////////////////////////////////////////////////////
 // TheoryAtomStringBuilder
 /////////////////////////////////////////////////////////////////////////////////////////
+struct TheoryAtomStringBuilder::Cache {
+	// Only short representations are cached so that nested terms cannot make text grow
+	// quadratically. Once text would exceed MAX_TEXT bytes, the cache is cleared, which
+	// also keeps offsets within 32 bits.
+	enum { MAX_ENTRY = 4096, MAX_TEXT = 1u << 24 };
+	struct Entry {
+		bool cached() const { return len != UINT32_MAX; }
+		uint32_t pos;
+		uint32_t len;
+	};
+	typedef PagedMap<Entry> EntryMap;
+	Cache() : entries(noEntry()), version(0) {}
+	static Entry noEntry() { Entry e = {0, UINT32_MAX}; return e; }
+	void validate(const TheoryData& td) {
+		if (version != td.termVersion()) {
+			clear();
+			version = td.termVersion();
+		}
+	}
+	void clear() {
+		entries.clear();
+		std::string().swap(text);
+		version = 0;
+	}
+	const Entry* find(Id_t termId) const {
+		const Entry* e = entries.find(termId);
+		return e && e->cached() ? e : 0;
+	}
+	void add(Id_t termId, const std::string& str) {
+		if (str.size() > MAX_ENTRY) { return; }
+		if (text.size() + str.size() > MAX_TEXT) {
+			uint32_t v = version;
+			clear();
+			version = v;
+		}
+		Entry& e = entries[termId];
+		e.pos = static_cast<uint32_t>(text.size());
+		e.len = static_cast<uint32_t>(str.size());
+		text.append(str);
+	}
+	EntryMap    entries; // maps term ids to ranges in text
+	std::string text;    // rendered compound terms
+	uint32_t    version; // term version of the TheoryData object the entries belong to
+};
+TheoryAtomStringBuilder::TheoryAtomStringBuilder() : out_(0), cache_(new Cache()) {}
+TheoryAtomStringBuilder::~TheoryAtomStringBuilder() {
+	delete cache_;
+}
+void TheoryAtomStringBuilder::clearCache() {
+	cache_->clear();
+}
+TheoryAtomStringBuilder& TheoryAtomStringBuilder::add(char c)               { out_->append(1, c); return *this; }
+TheoryAtomStringBuilder& TheoryAtomStringBuilder::add(const char* s)        { out_->append(s); return *this; }
+TheoryAtomStringBuilder& TheoryAtomStringBuilder::add(const std::string& s) { out_->append(s.data(), s.size()); return *this; }
 std::string TheoryAtomStringBuilder::toString(const TheoryData& td, const TheoryAtom& a) {
-	res_.clear();
-	add('&').term(td, td.getTerm(a.term())).add('{');
+	std::string res;
+	StringBuilder out(res);
+	toString(td, a, out);
+	return res;
+}
+StringBuilder& TheoryAtomStringBuilder::toString(const TheoryData& td, const TheoryAtom& a, StringBuilder& out) {
+	cache_->validate(td);
+	out_ = &out;
+	add('&').term(td, a.term()).add('{');
 	const char* sep = "";
 	for (TheoryElement::iterator eIt = a.begin(), eEnd = a.end(); eIt != eEnd; ++eIt, sep = "; ") {
 		add(sep).element(td, td.getElement(*eIt));
 	}
 	add('}');
 	if (a.guard()) {
-		add(' ').term(td, td.getTerm(*a.guard()));
+		add(' ').term(td, *a.guard());
 	}
 	if (a.rhs()) {
-		add(' ').term(td, td.getTerm(*a.rhs()));
+		add(' ').term(td, *a.rhs());
 	}
-	return res_;
+	out_ = 0;
+	return out;
 }
 bool TheoryAtomStringBuilder::function(const TheoryData& td, const TheoryTerm& f) {
-	TheoryTerm x = td.getTerm(f.function());
+	const TheoryTerm& x = td.getTerm(f.function());
 	if (x.type() == Theory_t::Symbol && std::strchr("/!<=>+-*\\?&@|:;~^.", *x.symbol()) != 0) {
 		if (f.size() == 1) {
-			term(td, x).term(td, td.getTerm(*f.begin()));
+			term(td, f.function()).term(td, *f.begin());
 			return false;
 		}
 		else if (f.size() == 2) {
-			term(td, td.getTerm(*f.begin())).add(' ').term(td, x).add(' ').term(td, td.getTerm(*(f.begin() + 1)));
+			term(td, *f.begin()).add(' ').term(td, f.function()).add(' ').term(td, *(f.begin() + 1));
 			return false;
 		}
 	}
-	term(td, x);
+	term(td, f.function());
 	return true;
 }
-TheoryAtomStringBuilder& TheoryAtomStringBuilder::term(const TheoryData& data, const TheoryTerm& t) {
+TheoryAtomStringBuilder& TheoryAtomStringBuilder::term(const TheoryData& data, Id_t termId) {
+	const TheoryTerm& t = data.getTerm(termId);
 	switch (t.type()) {
 		default: assert(false);
-		case Theory_t::Number: add(Potassco::toString(t.number())); break;
+		case Theory_t::Number: out_->append(t.number()); break;
 		case Theory_t::Symbol: add(t.symbol()); break;
 		case Theory_t::Compound: {
+			if (const Cache::Entry* e = cache_->find(termId)) {
+				out_->append(cache_->text.data() + e->pos, e->len);
+				break;
+			}
+			// Render into a separate buffer so that the cached text is complete even
+			// if out_ has a fixed size.
+			std::string buf;
+			StringBuilder temp(buf), *out = out_;
+			out_ = &temp;
 			if (!t.isFunction() || function(data, t)) {
 				const char* parens = Potassco::toString(t.isTuple() ? t.tuple() : Potassco::Tuple_t::Paren);
 				const char* sep = "";
 				add(parens[0]);
 				for (TheoryTerm::iterator it = t.begin(), end = t.end(); it != end; ++it, sep = ", ") {
-					add(sep).term(data, data.getTerm(*it));
+					add(sep).term(data, *it);
 				}
 				add(parens[1]);
 			}
+			out_ = out;
+			cache_->add(termId, buf);
+			out_->append(buf.data(), buf.size());
 		}
 	}
 	return *this;
@@ -624,7 +739,7 @@ TheoryAtomStringBuilder& TheoryAtomStringBuilder::term(const TheoryData& data, c
 TheoryAtomStringBuilder& TheoryAtomStringBuilder::element(const TheoryData& data, const TheoryElement& e) {
 	const char* sep = "";
 	for (TheoryElement::iterator it = e.begin(), end = e.end(); it != end; ++it, sep = ", ") {
-		add(sep).term(data, data.getTerm(*it));
+		add(sep).term(data, *it);
 	}
 	if (e.condition()) {
 		LitSpan cond = getCondition(e.condition());
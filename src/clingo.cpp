@@ -30,6 +30,16 @@ bool AbstractAssignment::isFalse(Lit_t lit) const { return value(lit) == Value_t
 uint32_t AbstractAssignment::trailEnd(uint32_t level) const {
 	return level < this->level() ? this->trailBegin(level + 1) : this->trailSize();
 }
+void AbstractAssignment::values(const LitSpan& lits, Value_t* out) const {
+	for (LitSpan::iterator it = begin(lits), end = Potassco::end(lits); it != end; ++it) { *out++ = value(*it); }
+}
+void AbstractAssignment::levels(const LitSpan& lits, uint32_t* out) const {
+	for (LitSpan::iterator it = begin(lits), end = Potassco::end(lits); it != end; ++it) { *out++ = level(*it); }
+}
+LitSpan AbstractAssignment::trail(uint32_t pos, uint32_t n, Lit_t* buf) const {
+	for (uint32_t i = 0; i != n; ++i) { buf[i] = trailAt(pos + i); }
+	return toSpan(buf, n);
+}
 
 AbstractSolver::~AbstractSolver() {}
 AbstractPropagator::~AbstractPropagator() {}
@@ -23,10 +23,15 @@
 //
 #include <potassco/convert.h>
 #include <potassco/string_convert.h>
+#include <potassco/span_table.h>
+#include <potassco/arena.h>
+#include <potassco/paged_map.h>
 #include <algorithm>
 #include <cstring>
 #include <vector>
-#include <map>
+#include <climits>
+#include <cstdio>
+#include <functional>
 #include <string>
 #include POTASSCO_EXT_INCLUDE(unordered_map)
 typedef POTASSCO_EXT_NS::unordered_map<Potassco::Atom_t, const char*> SymTab;
@@ -35,6 +40,187 @@ typedef POTASSCO_EXT_NS::unordered_map<Potassco::Atom_t, const char*> SymTab;
 #endif
 namespace Potassco {
 /////////////////////////////////////////////////////////////////////////////////////////
+// Temporary storage for spilled step data
+/////////////////////////////////////////////////////////////////////////////////////////
+namespace {
+// A contiguous range of records in a spill file.
+struct SpillRun {
+	uint64_t beg;
+	uint64_t end;
+};
+typedef std::vector<SpillRun> RunVec;
+// A lazily created temporary file that is reused for each step.
+class SpillFile {
+public:
+	SpillFile() : file_(0), size_(0), fpos_(0) {}
+	~SpillFile() { if (file_) { std::fclose(file_); } }
+	uint64_t size() const { return size_; }
+	void write(const void* data, std::size_t n) {
+		if (!file_) { POTASSCO_EXPECT((file_ = std::tmpfile()) != 0, "could not create temporary file"); }
+		seek(size_);
+		POTASSCO_EXPECT(std::fwrite(data, 1, n, file_) == n, "could not write temporary file");
+		fpos_ = size_ += n;
+	}
+	void read(uint64_t pos, void* out, std::size_t n) {
+		assert(pos + n <= size_);
+		seek(pos);
+		POTASSCO_EXPECT(std::fread(out, 1, n, file_) == n, "could not read temporary file");
+		fpos_ = pos + n;
+	}
+	SpillRun startRun() const { SpillRun r = {size_, size_}; return r; }
+	void     clear() { size_ = 0; }
+private:
+	SpillFile(const SpillFile&);
+	SpillFile& operator=(const SpillFile&);
+	void seek(uint64_t pos) {
+		if (pos == fpos_) { return; }
+#if defined(_MSC_VER)
+		int res = _fseeki64(file_, static_cast<__int64>(pos), SEEK_SET);
+#else
+		POTASSCO_EXPECT(pos <= static_cast<uint64_t>(LONG_MAX), "temporary file too large");
+		int res = std::fseek(file_, static_cast<long>(pos), SEEK_SET);
+#endif
+		POTASSCO_EXPECT(res == 0, "could not seek in temporary file");
+		fpos_ = pos;
+	}
+	std::FILE* file_;
+	uint64_t   size_;
+	uint64_t   fpos_;
+};
+// Sequentially reads the records of a spill run.
+class SpillReader {
+public:
+	enum { BUF_SIZE = 16384 };
+	SpillReader(SpillFile& f, const SpillRun& r) : file_(&f), pos_(r.beg), end_(r.end), bpos_(0) {}
+	bool more() const { return bpos_ != buf_.size() || pos_ != end_; }
+	// Returns a pointer to the next n bytes of the run, which is valid until the next call.
+	const char* get(std::size_t n) {
+		if (buf_.size() - bpos_ < n) {
+			buf_.erase(buf_.begin(), buf_.begin() + static_cast<std::ptrdiff_t>(bpos_));
+			bpos_ = 0;
+			std::size_t old = buf_.size();
+			std::size_t m   = static_cast<std::size_t>(std::min(end_ - pos_, static_cast<uint64_t>(std::max(n - old, static_cast<std::size_t>(BUF_SIZE)))));
+			POTASSCO_ASSERT(old + m >= n, "invalid temporary file");
+			buf_.resize(old + m);
+			file_->read(pos_, &buf_[old], m);
+			pos_ += m;
+		}
+		const char* r = &buf_[bpos_];
+		bpos_ += n;
+		return r;
+	}
+	template <class T>
+	T read() {
+		T x;
+		std::memcpy(&x, get(sizeof(T)), sizeof(T));
+		return x;
+	}
+private:
+	SpillFile*        file_;
+	uint64_t          pos_;
+	uint64_t          end_;
+	std::vector<char> buf_;
+	std::size_t       bpos_;
+};
+// Buffers the records of a new spill run.
+class SpillWriter {
+public:
+	enum { BUF_SIZE = SpillReader::BUF_SIZE };
+	explicit SpillWriter(SpillFile& f) : file_(&f), run_(f.startRun()) {}
+	void write(const void* data, std::size_t n) {
+		const char* p = static_cast<const char*>(data);
+		if (buf_.size() + n > BUF_SIZE) { flush(); }
+		if (n >= BUF_SIZE) { file_->write(p, n); }
+		else               { buf_.insert(buf_.end(), p, p + n); }
+	}
+	// Writes all buffered records and returns the completed run.
+	SpillRun finish() {
+		flush();
+		run_.end = file_->size();
+		return run_;
+	}
+private:
+	void flush() {
+		if (!buf_.empty()) { file_->write(&buf_[0], buf_.size()); buf_.clear(); }
+	}
+	SpillFile*        file_;
+	SpillRun          run_;
+	std::vector<char> buf_;
+};
+// Orders readers by their current record - ties are broken by run index.
+template <class T, class C>
+struct ByHead {
+	ByHead(const std::vector<T>& h, C c) : heads(&h), cmp(c) {}
+	bool operator()(std::size_t lhs, std::size_t rhs) const {
+		const T& l = (*heads)[lhs], &r = (*heads)[rhs];
+		// inverted for use with std heap functions
+		return cmp(r, l) || (!cmp(l, r) && rhs < lhs);
+	}
+	const std::vector<T>* heads;
+	C                     cmp;
+};
+// Merges sorted spill runs with a fan-in of at most MAX_RUNS.
+// The record type R is an ordering on R::Value that also provides
+// static read(SpillReader&, Value&) and write(SpillWriter&, const Value&) functions.
+template <class R>
+class SpillMerge {
+public:
+	typedef typename R::Value Value;
+	enum { MAX_RUNS = 16 };
+	// Repeatedly merges groups of MAX_RUNS consecutive runs into new runs until at most MAX_RUNS runs are left.
+	// Since groups keep their relative order, records that compare equal keep their order, too.
+	static void reduce(SpillFile& f, RunVec& runs) {
+		while (runs.size() > MAX_RUNS) {
+			RunVec next;
+			for (std::size_t i = 0, n; i < runs.size(); i += n) {
+				n = std::min(runs.size() - i, static_cast<std::size_t>(MAX_RUNS));
+				if (n == 1) { next.push_back(runs[i]); continue; }
+				SpillMerge  m(f, &runs[i], n);
+				SpillWriter w(f);
+				for (; !m.empty(); m.pop()) { R::write(w, m.top()); }
+				next.push_back(w.finish());
+			}
+			runs.swap(next);
+		}
+	}
+	SpillMerge() {}
+	SpillMerge(SpillFile& f, const SpillRun* runs, std::size_t n) { open(f, runs, n); }
+	void open(SpillFile& f, const SpillRun* runs, std::size_t n) {
+		POTASSCO_ASSERT(n <= MAX_RUNS, "too many runs");
+		readers_.reserve(n);
+		heads_.resize(n);
+		for (std::size_t i = 0; i != n; ++i) {
+			readers_.push_back(SpillReader(f, runs[i]));
+			if (readers_[i].more()) {
+				R::read(readers_[i], heads_[i]);
+				heap_.push_back(i);
+			}
+		}
+		std::make_heap(heap_.begin(), heap_.end(), cmp());
+	}
+	bool         empty() const { return heap_.empty(); }
+	// Returns the smallest record, which is valid until the next call to pop().
+	const Value& top()   const { return heads_[heap_[0]]; }
+	void         pop() {
+		std::pop_heap(heap_.begin(), heap_.end(), cmp());
+		std::size_t r = heap_.back();
+		if (readers_[r].more()) {
+			R::read(readers_[r], heads_[r]);
+			std::push_heap(heap_.begin(), heap_.end(), cmp());
+		}
+		else {
+			heap_.pop_back();
+		}
+	}
+private:
+	typedef ByHead<Value, R> Cmp;
+	Cmp cmp() const { return Cmp(heads_, R()); }
+	std::vector<SpillReader> readers_;
+	std::vector<Value>       heads_;
+	std::vector<std::size_t> heap_;
+};
+} // namespace
+/////////////////////////////////////////////////////////////////////////////////////////
 // SmodelsConvert::SmData
 /////////////////////////////////////////////////////////////////////////////////////////
 struct SmodelsConvert::SmData {
@@ -53,36 +239,62 @@ struct SmodelsConvert::SmData {
 		unsigned    prio;
 		unsigned    cond;
 	};
+	struct MinLit {
+		Weight_t prio;
+		uint32_t pos;   // position of (first) occurrence
+		Lit_t    lit;   // 0 for a priority without literals
+		Weight_t weight;
+		struct ByLit { bool operator()(const MinLit& lhs, const MinLit& rhs) const {
+			return lhs.prio != rhs.prio ? lhs.prio < rhs.prio : (lhs.lit != rhs.lit ? lhs.lit < rhs.lit : lhs.pos < rhs.pos);
+		}};
+		struct ByPos { bool operator()(const MinLit& lhs, const MinLit& rhs) const {
+			return lhs.prio != rhs.prio ? lhs.prio < rhs.prio : lhs.pos < rhs.pos;
+		}};
+	};
 	struct Symbol {
-		unsigned     atom : 31;
-		unsigned     hash :  1;
+		Atom_t       atom;
 		const char*  name;
 		bool operator<(const Symbol& rhs) const { return atom < rhs.atom; }
 	};
-	typedef std::vector<Atom>           AtomMap;
+	// Spill record formats for use with SpillMerge.
+	struct MinRec : MinLit::ByLit {
+		typedef MinLit Value;
+		static void read(SpillReader& r, MinLit& out)      { out = r.read<MinLit>(); }
+		static void write(SpillWriter& w, const MinLit& x) { w.write(&x, sizeof(x)); }
+	};
+	struct OutRec : std::less<Symbol> {
+		typedef Symbol Value;
+		// (atom, length, zero-terminated name)
+		static void read(SpillReader& r, Symbol& out) {
+			out.atom     = r.read<uint32_t>();
+			uint32_t len = r.read<uint32_t>();
+			out.name     = r.get(len + 1);
+		}
+		static void write(SpillWriter& w, const Symbol& x) {
+			uint32_t hdr[2] = {x.atom, static_cast<uint32_t>(std::strlen(x.name))};
+			w.write(hdr, sizeof(hdr));
+			w.write(x.name, hdr[1] + 1);
+		}
+	};
+	typedef PagedMap<Atom>              AtomMap;
 	typedef std::vector<Atom_t>         AtomVec;
 	typedef std::vector<Lit_t>          LitVec;
 	typedef std::vector<WeightLit_t>    WLitVec;
 	typedef std::vector<Heuristic>      HeuVec;
-	typedef std::map<Weight_t, WLitVec> MinMap;
+	typedef std::vector<MinLit>         MinVec;
 	typedef std::vector<Symbol>         OutVec;
-	SmData() : next_(2) {}
-	~SmData() {
-		flushStep();
-		for (SymTab::iterator it = symTab_.begin(), end = symTab_.end(); it != end; ++it) {
-			delete [] it->second;
-		}
-	}
+	typedef SpanTable<Lit_t>            CondTab;
+	enum { DEFAULT_COND_LIMIT = 1u << 26 };
+	explicit SmData(Allocator* alloc) : atoms_(Atom(), alloc), names_(Arena::DEFAULT_BLOCK_SIZE, alloc), stepNames_(Arena::DEFAULT_BLOCK_SIZE, alloc), conds_(alloc), next_(2), limit_(0), condLimit_(DEFAULT_COND_LIMIT), minPos_(0) {}
 	Atom_t newAtom()   { return next_++; }
 	Atom_t falseAtom() { return 1; }
 	bool   mapped(Atom_t a) const {
-		return a < atoms_.size() && atoms_[a].smId != 0;
+		return atoms_.get(a).smId != 0;
 	}
 	Atom&  mapAtom(Atom_t a) {
-		if (mapped(a)) { return atoms_[a]; }
-		if (a >= atoms_.size()) { atoms_.resize(a + 1); }
-		atoms_[a].smId = next_++;
-		return atoms_[a];
+		Atom& x = atoms_[a];
+		if (!x.smId) { x.smId = next_++; }
+		return x;
 	}
 	Lit_t  mapLit(Lit_t in) {
 		Lit_t x = static_cast<Lit_t>(mapAtom(atom(in)));
@@ -106,17 +318,23 @@ struct SmodelsConvert::SmData {
 	}
 	const char* addOutput(Atom_t atom, const StringSpan&, bool addHash);
 	void addMinimize(Weight_t prio, const WeightLitSpan& lits) {
-		WLitVec& body = minimize_[prio];
-		body.reserve(body.size() + size(lits));
+		if (empty(lits)) {
+			// keep the priority so that an empty minimize statement is emitted for it
+			MinLit x = {prio, minPos_++, 0, 0};
+			minimize_.push_back(x);
+			return;
+		}
+		minimize_.reserve(minimize_.size() + size(lits));
 		for (const WeightLit_t* it = begin(lits); it != end(lits); ++it) {
-			WeightLit_t x = *it;
-			if (weight(x) < 0) {
+			MinLit x = {prio, minPos_++, lit(*it), weight(*it)};
+			if (x.weight < 0) {
 				x.lit = -x.lit;
 				x.weight = -x.weight;
 			}
-			body.push_back(x);
+			minimize_.push_back(x);
 		}
 	}
+	class MinSource;
 	void addExternal(Atom_t a, Value_t v) {
 		Atom& ma = mapAtom(a);
 		if (!ma.head) {
@@ -129,23 +347,73 @@ struct SmodelsConvert::SmData {
 		heuristic_.push_back(h);
 	}
 	void flushStep() {
-		minimize_.clear();
+		MinVec().swap(minimize_);
 		AtomVec().swap(extern_);
 		HeuVec().swap(heuristic_);
-		for (; !output_.empty(); output_.pop_back()) {
-			if (!output_.back().hash) { delete [] output_.back().name; }
+		OutVec().swap(output_);
+		stepNames_.release();
+		RunVec().swap(minRuns_);
+		RunVec().swap(extRuns_);
+		RunVec().swap(heuRuns_);
+		RunVec().swap(outRuns_);
+		file_.clear();
+		minPos_ = 0;
+	}
+	// Returns the (approximate) number of bytes used for buffering the current step.
+	std::size_t stepBytes() const {
+		return (minimize_.size() * sizeof(MinLit)) + (extern_.size() * sizeof(Atom_t))
+			+ (heuristic_.size() * sizeof(Heuristic)) + (output_.size() * sizeof(Symbol)) + stepNames_.capacity();
+	}
+	void checkLimit() {
+		if (limit_ && stepBytes() > limit_) {
+			spillMinimize();
+			spillExternal();
+			spillHeuristic();
+			spillOutput();
 		}
 	}
+	template <class T>
+	void spill(std::vector<T>& vec, RunVec& runs) {
+		if (vec.empty()) { return; }
+		SpillRun r = file_.startRun();
+		file_.write(&vec[0], vec.size() * sizeof(T));
+		r.end = file_.size();
+		runs.push_back(r);
+		std::vector<T>().swap(vec);
+	}
+	template <class T>
+	const std::vector<T>& load(const SpillRun& r, std::vector<T>& out) {
+		out.resize(static_cast<std::size_t>((r.end - r.beg) / sizeof(T)));
+		if (!out.empty()) { file_.read(r.beg, &out[0], out.size() * sizeof(T)); }
+		return out;
+	}
+	void spillMinimize()  { std::sort(minimize_.begin(), minimize_.end(), MinLit::ByLit()); spill(minimize_, minRuns_); }
+	void spillExternal()  { spill(extern_, extRuns_); }
+	void spillHeuristic() { spill(heuristic_, heuRuns_); }
+	void spillOutput();
 	AtomMap atoms_;    // maps input atoms to output atoms
-	MinMap  minimize_; // maps priorities to minimize statements
+	MinVec  minimize_; // minimize literals of all priorities
 	AtomVec head_;     // active rule head
 	LitVec  lits_;     // active body literals
+	LitVec  cond_;     // active normalized condition
 	WLitVec wlits_;    // active weight body literals
 	AtomVec extern_;   // external atoms
 	HeuVec  heuristic_;// list of heuristic modifications not yet processed
-	SymTab  symTab_;
+	SymTab  symTab_;   // maps atoms to their (first) name
+	Arena   names_;    // names in symTab_
+	Arena   stepNames_;// names of the current step not in symTab_
 	OutVec  output_;   // list of output atoms not yet processed
+	CondTab conds_;    // maps normalized conditions to their aux atoms (of all steps)
 	Atom_t  next_;     // next unused output atom
+	// spilled step data
+	SpillFile   file_;
+	RunVec      minRuns_;
+	RunVec      extRuns_;
+	RunVec      heuRuns_;
+	RunVec      outRuns_; // sorted by atom; records are OutRec
+	std::size_t limit_;   // max bytes to buffer in memory (0 = no limit)
+	std::size_t condLimit_; // max bytes of conds_ before it is cleared (0 = no limit)
+	uint32_t    minPos_;  // next position for minimize literals
 };
 AtomSpan SmodelsConvert::SmData::mapHead(const AtomSpan& h) {
 	head_.clear();
@@ -155,20 +423,57 @@ AtomSpan SmodelsConvert::SmData::mapHead(const AtomSpan& h) {
 	if (head_.empty()) { head_.push_back(falseAtom()); }
 	return toSpan(head_);
 }
-const char* SmodelsConvert::SmData::addOutput(Atom_t atom, const StringSpan& str, bool addHash) {
-	char* n = new char[str.size + 1];
-	*std::copy(begin(str), end(str), n) = 0;
-	Symbol s; s.atom = atom; s.name = n; s.hash = 0;
-	if (addHash && symTab_.insert(SymTab::value_type(atom, s.name)).second) {
-		s.hash = 1;
+// Provides the minimize literals of a step ordered by priority and literal.
+class SmodelsConvert::SmData::MinSource {
+public:
+	explicit MinSource(SmData& d) : data_(&d), pos_(0) {
+		if (d.minRuns_.empty()) {
+			std::sort(d.minimize_.begin(), d.minimize_.end(), MinLit::ByLit());
+			return;
+		}
+		d.spillMinimize();
+		SpillMerge<MinRec>::reduce(d.file_, d.minRuns_);
+		merge_.open(d.file_, &d.minRuns_[0], d.minRuns_.size());
+	}
+	bool next(MinLit& out) {
+		if (data_->minRuns_.empty()) {
+			if (pos_ == data_->minimize_.size()) { return false; }
+			out = data_->minimize_[pos_++];
+			return true;
+		}
+		if (merge_.empty()) { return false; }
+		out = merge_.top();
+		merge_.pop();
+		return true;
 	}
+private:
+	SmData*            data_;
+	std::size_t        pos_;
+	SpillMerge<MinRec> merge_;
+};
+void SmodelsConvert::SmData::spillOutput() {
+	if (output_.empty()) { return; }
+	std::stable_sort(output_.begin(), output_.end());
+	SpillWriter w(file_);
+	for (OutVec::const_iterator it = output_.begin(), end = output_.end(); it != end; ++it) { OutRec::write(w, *it); }
+	outRuns_.push_back(w.finish());
+	OutVec().swap(output_);
+	stepNames_.release();
+}
+const char* SmodelsConvert::SmData::addOutput(Atom_t atom, const StringSpan& str, bool addHash) {
+	std::pair<SymTab::iterator, bool> res(symTab_.end(), false);
+	if (addHash) { res = symTab_.insert(SymTab::value_type(atom, static_cast<const char*>(0))); }
+	Symbol s;
+	s.atom = atom;
+	s.name = (res.second ? names_ : stepNames_).copy(begin(str), size(str));
+	if (res.second) { res.first->second = s.name; }
 	output_.push_back(s);
 	return s.name;
 }
 /////////////////////////////////////////////////////////////////////////////////////////
 // SmodelsConvert
 /////////////////////////////////////////////////////////////////////////////////////////
-SmodelsConvert::SmodelsConvert(AbstractProgram& out, bool ext) : out_(out), data_(new SmData), ext_(ext) {}
+SmodelsConvert::SmodelsConvert(AbstractProgram& out, bool ext, Allocator* alloc) : out_(out), data_(new SmData(alloc)), ext_(ext) {}
 SmodelsConvert::~SmodelsConvert() {
 	delete data_;
 }
@@ -185,9 +490,27 @@ const char* SmodelsConvert::getName(Atom_t a) const {
 Atom_t SmodelsConvert::makeAtom(const LitSpan& cond, bool named) {
 	Atom_t id = 0;
 	if (size(cond) != 1 || cond[0] < 0 || (data_->mapAtom(atom(cond[0])).show && named)) {
-		// aux :- cond.
-		Atom_t aux = (id = data_->newAtom());
-		out_.rule(Head_t::Disjunctive, toSpan(&aux, 1), data_->mapLits(cond, data_->lits_));
+		// aux :- cond. - reuse aux atom of an equivalent condition if possible
+		SmData::LitVec& norm = data_->cond_;
+		norm.assign(begin(cond), end(cond));
+		std::sort(norm.begin(), norm.end());
+		norm.erase(std::unique(norm.begin(), norm.end()), norm.end());
+		if (data_->condLimit_ && data_->conds_.bytes() > data_->condLimit_) { data_->conds_.clear(); }
+		SmData::CondTab::InsertResult r = data_->conds_.insert(toSpan(norm), 0);
+		if (r.second) {
+			id = r.first->value = data_->newAtom();
+			out_.rule(Head_t::Disjunctive, toSpan(&id, 1), data_->mapLits(toSpan(norm), data_->lits_));
+		}
+		else if (named) {
+			// the existing aux atom may already have a name - derive a fresh atom from it
+			// so that no atom gets more than one name
+			Lit_t aux = static_cast<Lit_t>(r.first->value);
+			id = data_->newAtom();
+			out_.rule(Head_t::Disjunctive, toSpan(&id, 1), toSpan(&aux, 1));
+		}
+		else {
+			id = r.first->value;
+		}
 	}
 	else {
 		SmData::Atom& ma = data_->mapAtom(atom(*begin(cond)));
@@ -223,28 +546,40 @@ void SmodelsConvert::rule(Head_t ht, const AtomSpan& head, Weight_t bound, const
 	}
 }
 
+void SmodelsConvert::setSpillLimit(std::size_t n) {
+	data_->limit_ = n;
+	data_->checkLimit();
+}
+void SmodelsConvert::setConditionLimit(std::size_t n) {
+	data_->condLimit_ = n;
+}
 void SmodelsConvert::minimize(Weight_t prio, const WeightLitSpan& lits) {
 	data_->addMinimize(prio, lits);
+	data_->checkLimit();
 }
 void SmodelsConvert::output(const StringSpan& str, const LitSpan& cond) {
 	// create a unique atom for cond and set its name to str
 	data_->addOutput(makeAtom(cond, true), str, true);
+	data_->checkLimit();
 }
 
 void SmodelsConvert::external(Atom_t a, Value_t v) {
 	data_->addExternal(a, v);
+	data_->checkLimit();
 }
 void SmodelsConvert::heuristic(Atom_t a, Heuristic_t t, int bias, unsigned prio, const LitSpan& cond) {
 	if (!ext_) { out_.heuristic(a, t, bias, prio, cond); }
 	// create unique atom representing _heuristic(...)
 	Atom_t heuPred = makeAtom(cond, true);
 	data_->addHeuristic(a, t, bias, prio, heuPred);
+	data_->checkLimit();
 }
 void SmodelsConvert::acycEdge(int s, int t, const LitSpan& condition) {
 	if (!ext_) { out_.acycEdge(s, t, condition); }
 	StringBuilder buf;
-	buf.appendFormat("_edge(%d,%d)", s, t);
+	buf.append("_edge(").append(s).append(",").append(t).append(")");
 	data_->addOutput(makeAtom(condition, true), toSpan(buf), false);
+	data_->checkLimit();
 }
 
 void SmodelsConvert::flush() {
@@ -261,24 +596,50 @@ void SmodelsConvert::endStep() {
 	out_.endStep();
 }
 void SmodelsConvert::flushMinimize() {
-	for (SmData::MinMap::iterator it = data_->minimize_.begin(), end = data_->minimize_.end(); it != end; ++it) {
-		out_.minimize(it->first, data_->mapLits(toSpan(it->second), data_->wlits_));
+	// Merge duplicate literals of a priority: weights of duplicates are summed up, literals
+	// with a total weight of 0 are removed, and sums exceeding the range of Weight_t are split.
+	// Within a priority, literals keep the order of their first occurrence. Each priority
+	// yields exactly one minimize statement, which is empty if none of its literals remain.
+	SmData::MinSource src(*data_);
+	SmData::MinVec    lits;
+	SmData::MinLit    x;
+	for (bool more = src.next(x); more;) {
+		Weight_t prio = x.prio;
+		lits.clear();
+		while (more && x.prio == prio) {
+			SmData::MinLit m = x;
+			int64_t        w = 0;
+			do { w += x.weight; } while ((more = src.next(x)) == true && x.prio == m.prio && x.lit == m.lit);
+			for (m.weight = INT_MAX; w > INT_MAX; w -= INT_MAX) { lits.push_back(m); }
+			if (w) { m.weight = static_cast<Weight_t>(w); lits.push_back(m); }
+		}
+		std::sort(lits.begin(), lits.end(), SmData::MinLit::ByPos());
+		data_->wlits_.clear();
+		for (SmData::MinVec::const_iterator it = lits.begin(), end = lits.end(); it != end; ++it) {
+			WeightLit_t wl = {data_->mapLit(it->lit), it->weight};
+			data_->wlits_.push_back(wl);
+		}
+		out_.minimize(prio, toSpan(data_->wlits_));
 	}
 }
 void SmodelsConvert::flushExternal() {
 	LitSpan T = toSpan<Lit_t>();
 	data_->head_.clear();
-	for (SmData::AtomVec::const_iterator it = data_->extern_.begin(), end = data_->extern_.end(); it != end; ++it) {
-		SmData::Atom& a = data_->mapAtom(*it);
-		Value_t vt = static_cast<Value_t>(a.extn);
-		if (!ext_) {
-			if (a.head) { continue; }
-			Atom_t at = a;
-			if      (vt == Value_t::Free) { data_->head_.push_back(at); }
-			else if (vt == Value_t::True) { out_.rule(Head_t::Disjunctive, toSpan(&at, 1), T); }
-		}
-		else {
-			out_.external(a, vt);
+	SmData::AtomVec temp;
+	for (std::size_t r = 0, n = data_->extRuns_.size(); r <= n; ++r) {
+		const SmData::AtomVec& ext = r != n ? data_->load(data_->extRuns_[r], temp) : data_->extern_;
+		for (SmData::AtomVec::const_iterator it = ext.begin(), end = ext.end(); it != end; ++it) {
+			SmData::Atom& a = data_->mapAtom(*it);
+			Value_t vt = static_cast<Value_t>(a.extn);
+			if (!ext_) {
+				if (a.head) { continue; }
+				Atom_t at = a;
+				if      (vt == Value_t::Free) { data_->head_.push_back(at); }
+				else if (vt == Value_t::True) { out_.rule(Head_t::Disjunctive, toSpan(&at, 1), T); }
+			}
+			else {
+				out_.external(a, vt);
+			}
 		}
 	}
 	if (!data_->head_.empty()) {
@@ -287,28 +648,43 @@ void SmodelsConvert::flushExternal() {
 }
 void SmodelsConvert::flushHeuristic() {
 	StringBuilder buf;
-	for (SmData::HeuVec::const_iterator it = data_->heuristic_.begin(), end = data_->heuristic_.end(); it != end; ++it) {
-		const SmData::Heuristic& heu = *it;
-		if (!data_->mapped(heu.atom)) { continue; }
-		SmData::Atom& ma = data_->mapAtom(heu.atom);
-		const char* name = ma.show ? getName(ma.smId) : 0;
-		if (!name) {
-			ma.show = 1;
+	SmData::HeuVec temp;
+	for (std::size_t r = 0, n = data_->heuRuns_.size(); r <= n; ++r) {
+		const SmData::HeuVec& heus = r != n ? data_->load(data_->heuRuns_[r], temp) : data_->heuristic_;
+		for (SmData::HeuVec::const_iterator it = heus.begin(), end = heus.end(); it != end; ++it) {
+			const SmData::Heuristic& heu = *it;
+			if (!data_->mapped(heu.atom)) { continue; }
+			SmData::Atom& ma = data_->mapAtom(heu.atom);
+			const char* name = ma.show ? getName(ma.smId) : 0;
+			if (!name) {
+				ma.show = 1;
+				buf.clear();
+				buf.append("_atom(").append(static_cast<unsigned>(ma.smId)).append(")");
+				name = data_->addOutput(ma, toSpan(buf), true);
+			}
 			buf.clear();
-			buf.appendFormat("_atom(%u)", ma.smId);
-			name = data_->addOutput(ma, toSpan(buf), true);
+			buf.append("_heuristic(").append(name).append(",").append(toString(heu.type));
+			buf.append(",").append(heu.bias).append(",").append(heu.prio).append(")");
+			Lit_t c = static_cast<Lit_t>(heu.cond);
+			out_.output(toSpan(buf), toSpan(&c, 1));
 		}
-		buf.clear();
-		buf.appendFormat("_heuristic(%s,%s,%d,%u)", name, toString(heu.type), heu.bias, heu.prio);
-		Lit_t c = static_cast<Lit_t>(heu.cond);
-		out_.output(toSpan(buf), toSpan(&c, 1));
 	}
 }
 void SmodelsConvert::flushSymbols() {
-	std::sort(data_->output_.begin(), data_->output_.end());
-	for (SmData::OutVec::const_iterator it = data_->output_.begin(), end = data_->output_.end(); it != end; ++it) {
-		Lit_t x = static_cast<Lit_t>(it->atom);
-		out_.output(toSpan(it->name, std::strlen(it->name)), toSpan(&x, 1));
+	if (data_->outRuns_.empty()) {
+		std::stable_sort(data_->output_.begin(), data_->output_.end());
+		for (SmData::OutVec::const_iterator it = data_->output_.begin(), end = data_->output_.end(); it != end; ++it) {
+			Lit_t x = static_cast<Lit_t>(it->atom);
+			out_.output(toSpan(it->name, std::strlen(it->name)), toSpan(&x, 1));
+		}
+		return;
+	}
+	// merge sorted runs
+	data_->spillOutput();
+	SpillMerge<SmData::OutRec>::reduce(data_->file_, data_->outRuns_);
+	for (SpillMerge<SmData::OutRec> m(data_->file_, &data_->outRuns_[0], data_->outRuns_.size()); !m.empty(); m.pop()) {
+		Lit_t x = static_cast<Lit_t>(m.top().atom);
+		out_.output(toSpan(m.top().name, std::strlen(m.top().name)), toSpan(&x, 1));
 	}
 }
 
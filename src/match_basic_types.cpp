@@ -25,14 +25,23 @@
 #pragma warning (disable : 4996) // std::copy unsafe
 #endif
 #include <potassco/match_basic_types.h>
+#include <potassco/arena.h>
+#include <potassco/rule_utils.h>
 #include <cstring>
 #include <istream>
 #include <algorithm>
-#include <cstdio>
 namespace Potassco {
 AbstractProgram::~AbstractProgram() {}
 void AbstractProgram::initProgram(bool) {}
 void AbstractProgram::beginStep() {}
+void AbstractProgram::rules(const RuleBatch& batch) {
+	for (uint32_t i = 0, end = batch.size(); i != end; ++i) {
+		Rule_t r = batch.rule(i);
+		if      (batch.isMinimize(i)) { minimize(r.agg.bound, r.agg.lits); }
+		else if (r.normal())          { rule(r.ht, r.head, r.cond); }
+		else                          { rule(r.ht, r.head, r.agg.bound, r.agg.lits); }
+	}
+}
 void AbstractProgram::project(const AtomSpan&) { throw std::logic_error("projection directive not supported"); }
 void AbstractProgram::output(const StringSpan&, const LitSpan&) { throw std::logic_error("output directive not supported"); }
 void AbstractProgram::external(Atom_t, Value_t) { throw std::logic_error("external directive not supported"); }
@@ -137,6 +146,38 @@ int BufferedStream::copy(char* out, int max) {
 	}
 	return static_cast<int>(os);
 }
+bool BufferedStream::lineInBuffer(std::size_t eol) const {
+	// The newline must be followed by at least one buffered character so that extracting
+	// it does not trigger a refill of the buffer (unless the input is already exhausted).
+	char c = buf_[eol];
+	if (c == '\r' && buf_[eol + 1] == '\n') { c = buf_[++eol]; }
+	return (c && buf_[eol + 1]) || !str_;
+}
+bool BufferedStream::readLine(StringSpan& line, std::string& temp) {
+	std::size_t n = std::strcspn(buf_ + rpos_, "\r\n");
+	if (!lineInBuffer(rpos_ + n) && rpos_) {
+		// move partial line to front of buffer and refill
+		std::size_t len = n + std::strlen(buf_ + rpos_ + n);
+		std::memmove(buf_, buf_ + rpos_, len);
+		rpos_ = len;
+		underflow(false);
+		rpos_ = 0;
+		n = std::strcspn(buf_, "\r\n");
+	}
+	if (!lineInBuffer(rpos_ + n)) {
+		// line too long - copy to temp
+		temp.clear();
+		for (char c; (c = peek()) != 0 && c != '\n' && c != '\r';) { temp += rget(); }
+		line = toSpan(temp.c_str(), temp.size());
+		return get() == '\n';
+	}
+	char* s = buf_ + rpos_;
+	rpos_  += n;
+	bool nl = get() == '\n';
+	s[n]    = 0;
+	line    = toSpan(s, n);
+	return nl;
+}
 unsigned BufferedStream::line() const { return line_; }
 void BufferedStream::fail(unsigned line, const char* err) {
 	Potassco::fail(Potassco::error_logic, 0, 0, 0, "parse error in line %u: %s", line, err);
@@ -220,51 +261,90 @@ bool matchAtomArg(const char*& input, StringSpan& arg) {
 	input = scan;
 	return arg.size != 0;
 }
+// Returns whether input starts with the n characters in word and if so extracts them.
+static inline bool match(const char*& input, const char* word, std::size_t n) {
+	if (std::strncmp(input, word, n) != 0) { return false; }
+	input += n;
+	return true;
+}
+static inline bool matchChar(const char*& input, char c) {
+	if (*input != c) { return false; }
+	++input;
+	return true;
+}
+static inline bool isSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+// Scans an optionally signed integer with leading whitespace (i.e. the format accepted by "%d")
+// and returns a pointer past its last digit or 0 if input does not start with an integer.
+static const char* scanInt(const char* input) {
+	while (isSpace(*input)) { ++input; }
+	if (*input == '-' || *input == '+') { ++input; }
+	if (!BufferedStream::isDigit(*input)) { return 0; }
+	do { ++input; } while (BufferedStream::isDigit(*input));
+	return input;
+}
 bool match(const char*& input, Heuristic_t& heuType) {
-	for (unsigned x = 0; x <= static_cast<unsigned>(Heuristic_t::eMax); ++x) {
-		if (match(input, toString(static_cast<Heuristic_t>(x)))) {
-			heuType = static_cast<Heuristic_t>(x);
-			return true;
-		}
+	const char* x = input;
+	Heuristic_t t;
+	switch (*x) {
+		default : return false;
+		case 'l': t = Heuristic_t::Level; break;
+		case 's': t = Heuristic_t::Sign; break;
+		case 'f': t = x[1] == 'a' && x[2] == 'l' ? Heuristic_t::False : Heuristic_t::Factor; break;
+		case 'i': t = Heuristic_t::Init; break;
+		case 't': t = Heuristic_t::True; break;
 	}
-	return false;
+	const char* w = toString(t);
+	if (!match(x, w, std::strlen(w))) { return false; }
+	heuType = t;
+	input   = x;
+	return true;
 }
 
 bool match(const char*& input, int& out) {
-	char* eptr;
-	long t = std::strtol(input, &eptr, 10);
-	if (eptr == input || t < INT_MIN || t > INT_MAX) {
-		return false;
+	const char* x = input;
+	while (isSpace(*x)) { ++x; }
+	bool neg = *x == '-';
+	if (neg || *x == '+') { ++x; }
+	if (!BufferedStream::isDigit(*x)) { return false; }
+	int64_t t = 0;
+	for (const int64_t max = static_cast<int64_t>(INT_MAX) + neg; BufferedStream::isDigit(*x); ++x) {
+		t = (t * 10) + BufferedStream::toDigit(*x);
+		if (t > max) { return false; }
 	}
-	out = static_cast<int>(t);
-	input = eptr;
+	out = static_cast<int>(neg ? -t : t);
+	input = x;
 	return true;
 }
 
 int matchDomHeuPred(const char*& in, StringSpan& atom, Heuristic_t& type, int& bias, unsigned& prio) {
 	int p;
-	if (!match(in, begin(Heuristic_t::pred))) { return 0; }
-	if (!matchAtomArg(in, atom) || !match(in, ",")) { return -1; }
-	if (!match(in, type)        || !match(in, ",")) { return -2; }
+	if (in[0] != '_' || in[1] != 'h' || !match(in, begin(Heuristic_t::pred), size(Heuristic_t::pred))) { return 0; }
+	if (!matchAtomArg(in, atom) || !matchChar(in, ',')) { return -1; }
+	if (!match(in, type)        || !matchChar(in, ',')) { return -2; }
 	if (!match(in, bias)) { return -3; }
-	prio = static_cast<unsigned>(bias < 0 ? -bias : bias);
-	if (!match(in, ",")) { return match(in, ")") ? 1 : -3; }
+	prio = bias < 0 ? 0u - static_cast<unsigned>(bias) : static_cast<unsigned>(bias);
+	if (!matchChar(in, ',')) { return matchChar(in, ')') ? 1 : -3; }
 	if (!match(in, p) || p < 0) { return -4; }
 	prio = static_cast<unsigned>(p);
-	return match(in, ")") ? 1 : -4;
+	return matchChar(in, ')') ? 1 : -4;
 }
 
 int matchEdgePred(const char*& in, StringSpan& n0, StringSpan& n1) {
-	int sPos, tPos, ePos = -1;
-	if (sscanf(in, "_acyc_%*d_%n%*d_%n%*d%n", &sPos, &tPos, &ePos) == 0 && ePos > 0) {
-		n0 = toSpan(in + sPos, (tPos - sPos) - 1);
-		n1 = toSpan(in + tPos, ePos - tPos);
-		in += ePos;
-		return size(n0) > 0 && size(n1) > 0 ? 1 : -1;
+	if (in[0] != '_') { return 0; }
+	if (in[1] == 'a') { // _acyc_<int>_<int>_<int>
+		const char* x = in, *s, *t, *e;
+		if (match(x, "_acyc_", 6) && (x = scanInt(x)) != 0 && *x == '_'
+			&& (t = scanInt(s = x + 1)) != 0 && *t == '_'
+			&& (e = scanInt(++t)) != 0) {
+			n0 = toSpan(s, static_cast<std::size_t>((t - s) - 1));
+			n1 = toSpan(t, static_cast<std::size_t>(e - t));
+			in = e;
+			return 1;
+		}
 	}
-	else if (match(in, "_edge(")) {
-		if (!matchAtomArg(in, n0) || !match(in, ",")) { return -1; }
-		if (!matchAtomArg(in, n1) || !match(in, ")")) { return -2; }
+	else if (in[1] == 'e' && match(in, "_edge(", 6)) {
+		if (!matchAtomArg(in, n0) || !matchChar(in, ',')) { return -1; }
+		if (!matchAtomArg(in, n1) || !matchChar(in, ')')) { return -2; }
 		return 1;
 	}
 	return 0;
@@ -272,12 +352,12 @@ int matchEdgePred(const char*& in, StringSpan& n0, StringSpan& n1) {
 /////////////////////////////////////////////////////////////////////////////////////////
 // MemoryRegion
 /////////////////////////////////////////////////////////////////////////////////////////
-MemoryRegion::MemoryRegion(std::size_t init) : beg_(0), end_(0) {
+MemoryRegion::MemoryRegion(std::size_t init, Allocator* alloc) : beg_(0), end_(0), alloc_(&allocatorOrDefault(alloc)) {
 	grow(init);
 }
 MemoryRegion::~MemoryRegion() { release(); }
 void MemoryRegion::release() {
-	std::free(beg_);
+	if (beg_) { alloc_->deallocate(beg_, size()); }
 	beg_ = end_ = 0;
 }
 void* MemoryRegion::operator[](std::size_t idx) const {
@@ -286,13 +366,13 @@ void* MemoryRegion::operator[](std::size_t idx) const {
 void MemoryRegion::swap(MemoryRegion& other) {
 	std::swap(beg_, other.beg_);
 	std::swap(end_, other.end_);
+	std::swap(alloc_, other.alloc_);
 }
 void MemoryRegion::grow(std::size_t n) {
 	if (n > size()) {
 		std::size_t nc = std::max(n, (size() * 3) >> 1);
-		void* t = std::realloc(beg_, nc);
-		POTASSCO_CHECK(t, ENOMEM);
-		beg_ = t; end_ = static_cast<unsigned char*>(t)+n;
+		void* t = alloc_->reallocate(beg_, size(), nc);
+		beg_ = t; end_ = static_cast<unsigned char*>(t)+nc;
 	}
 }
 
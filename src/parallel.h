@@ -0,0 +1,87 @@
+//
+// Copyright (c) 2016-2017 Benjamin Kaufmann
+//
+// This file is part of Potassco.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+#ifndef POTASSCO_PARALLEL_H_INCLUDED
+#define POTASSCO_PARALLEL_H_INCLUDED
+#include <potassco/platform.h>
+#if POTASSCO_WITH_THREADS && ((defined(__cplusplus) && __cplusplus >= 201103L) || (defined(_MSC_VER) && _MSC_VER >= 1700))
+#define POTASSCO_HAS_THREADS 1
+#include <exception>
+#include <thread>
+#include <vector>
+#else
+#define POTASSCO_HAS_THREADS 0
+#endif
+namespace Potassco { namespace detail {
+// Returns the number of threads to use if n threads are requested.
+// A value of 0 requests one thread per hardware thread.
+inline unsigned numThreads(unsigned n) {
+#if POTASSCO_HAS_THREADS
+	if (n == 0) { n = std::thread::hardware_concurrency(); }
+	return n ? n : 1u;
+#else
+	(void)n;
+	return 1u;
+#endif
+}
+#if POTASSCO_HAS_THREADS
+template <class F>
+struct ParallelTask {
+	void operator()() const {
+		try { (*f)(i); }
+		catch (...) { *error = std::current_exception(); }
+	}
+	F*                  f;
+	unsigned            i;
+	std::exception_ptr* error;
+};
+#endif
+// Calls f(i) for each i in [0, n).
+// Calls with i > 0 run on separate threads, while f(0) runs on the calling thread.
+// Once all calls have finished, the first exception thrown (if any) is rethrown.
+// Without thread support, all calls run sequentially on the calling thread.
+template <class F>
+void parallelFor(unsigned n, F& f) {
+#if POTASSCO_HAS_THREADS
+	if (n > 1) {
+		std::vector<std::exception_ptr> errors(n);
+		std::vector<std::thread> workers;
+		workers.reserve(n - 1);
+		for (unsigned i = 1; i != n; ++i) {
+			ParallelTask<F> task = {&f, i, &errors[i]};
+			try        { workers.push_back(std::thread(task)); }
+			catch (...){ task(); }
+		}
+		ParallelTask<F> task = {&f, 0u, &errors[0]};
+		task();
+		for (std::size_t i = 0; i != workers.size(); ++i) { workers[i].join(); }
+		for (unsigned i = 0; i != n; ++i) {
+			if (errors[i]) { std::rethrow_exception(errors[i]); }
+		}
+		return;
+	}
+#endif
+	for (unsigned i = 0; i != n; ++i) { f(i); }
+}
+}} // namespace Potassco::detail
+#endif
@@ -0,0 +1,442 @@
+//
+// Copyright (c) 2016-2017 Benjamin Kaufmann
+//
+// This file is part of Potassco.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+#include <potassco/program_transform.h>
+#include <potassco/paged_map.h>
+#include <potassco/span_table.h>
+#include <potassco/rule_utils.h>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <string>
+#include <vector>
+namespace Potassco {
+/////////////////////////////////////////////////////////////////////////////////////////
+// AtomCompactor
+/////////////////////////////////////////////////////////////////////////////////////////
+struct AtomCompactor::Data {
+	typedef PagedMap<Atom_t>         AtomMap;
+	typedef std::vector<Atom_t>      AtomVec;
+	typedef std::vector<Lit_t>       LitVec;
+	typedef std::vector<WeightLit_t> WLitVec;
+	Data() { orig.push_back(0); }
+	Atom_t mapAtom(Atom_t a) {
+		Atom_t& x = atoms[a];
+		if (!x) {
+			x = static_cast<Atom_t>(orig.size());
+			orig.push_back(a);
+		}
+		return x;
+	}
+	Lit_t mapLit(Lit_t in) {
+		Lit_t x = static_cast<Lit_t>(mapAtom(atom(in)));
+		return in < 0 ? -x : x;
+	}
+	AtomSpan mapAtoms(const AtomSpan& in) {
+		head.clear();
+		for (const Atom_t* it = begin(in), *end = Potassco::end(in); it != end; ++it) { head.push_back(mapAtom(*it)); }
+		return toSpan(head);
+	}
+	LitSpan mapLits(const LitSpan& in) {
+		lits.clear();
+		for (const Lit_t* it = begin(in), *end = Potassco::end(in); it != end; ++it) { lits.push_back(mapLit(*it)); }
+		return toSpan(lits);
+	}
+	WeightLitSpan mapLits(const WeightLitSpan& in) {
+		wlits.clear();
+		for (const WeightLit_t* it = begin(in), *end = Potassco::end(in); it != end; ++it) {
+			WeightLit_t x = {mapLit(it->lit), it->weight};
+			wlits.push_back(x);
+		}
+		return toSpan(wlits);
+	}
+	AtomMap atoms; // maps input atoms to output atoms
+	AtomVec orig;  // maps output atoms to input atoms
+	AtomVec head;
+	LitVec  lits;
+	WLitVec wlits;
+};
+AtomCompactor::AtomCompactor(AbstractProgram& out) : out_(out), data_(new Data) {}
+AtomCompactor::~AtomCompactor() { delete data_; }
+void AtomCompactor::initProgram(bool inc) { out_.initProgram(inc); }
+void AtomCompactor::beginStep() { out_.beginStep(); }
+void AtomCompactor::rule(Head_t ht, const AtomSpan& head, const LitSpan& body) {
+	AtomSpan h = data_->mapAtoms(head);
+	out_.rule(ht, h, data_->mapLits(body));
+}
+void AtomCompactor::rule(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& body) {
+	AtomSpan h = data_->mapAtoms(head);
+	out_.rule(ht, h, bound, data_->mapLits(body));
+}
+void AtomCompactor::minimize(Weight_t prio, const WeightLitSpan& lits) {
+	out_.minimize(prio, data_->mapLits(lits));
+}
+void AtomCompactor::project(const AtomSpan& atoms) {
+	out_.project(data_->mapAtoms(atoms));
+}
+void AtomCompactor::output(const StringSpan& str, const LitSpan& condition) {
+	out_.output(str, data_->mapLits(condition));
+}
+void AtomCompactor::external(Atom_t a, Value_t v) {
+	out_.external(data_->mapAtom(a), v);
+}
+void AtomCompactor::assume(const LitSpan& lits) {
+	out_.assume(data_->mapLits(lits));
+}
+void AtomCompactor::heuristic(Atom_t a, Heuristic_t t, int bias, unsigned prio, const LitSpan& condition) {
+	Atom_t x = data_->mapAtom(a);
+	out_.heuristic(x, t, bias, prio, data_->mapLits(condition));
+}
+void AtomCompactor::acycEdge(int s, int t, const LitSpan& condition) {
+	out_.acycEdge(s, t, data_->mapLits(condition));
+}
+void AtomCompactor::theoryTerm(Id_t termId, int number) {
+	out_.theoryTerm(termId, number);
+}
+void AtomCompactor::theoryTerm(Id_t termId, const StringSpan& name) {
+	out_.theoryTerm(termId, name);
+}
+void AtomCompactor::theoryTerm(Id_t termId, int cId, const IdSpan& args) {
+	out_.theoryTerm(termId, cId, args);
+}
+void AtomCompactor::theoryElement(Id_t elementId, const IdSpan& terms, const LitSpan& cond) {
+	out_.theoryElement(elementId, terms, data_->mapLits(cond));
+}
+void AtomCompactor::theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements) {
+	out_.theoryAtom(atomOrZero ? data_->mapAtom(atomOrZero) : 0, termId, elements);
+}
+void AtomCompactor::theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements, Id_t op, Id_t rhs) {
+	out_.theoryAtom(atomOrZero ? data_->mapAtom(atomOrZero) : 0, termId, elements, op, rhs);
+}
+void AtomCompactor::endStep() { out_.endStep(); }
+Lit_t AtomCompactor::get(Lit_t lit) const {
+	Lit_t x = static_cast<Lit_t>(data_->atoms.get(atom(lit)));
+	return lit < 0 ? -x : x;
+}
+Atom_t AtomCompactor::original(Atom_t a) const {
+	return a < data_->orig.size() ? data_->orig[a] : 0;
+}
+Atom_t AtomCompactor::maxAtom() const {
+	return static_cast<Atom_t>(data_->orig.size() - 1);
+}
+/////////////////////////////////////////////////////////////////////////////////////////
+// DuplicateFilter
+/////////////////////////////////////////////////////////////////////////////////////////
+// Directives are identified by a key consisting of a tag followed by their canonical
+// (i.e. sorted) contents. Sets of atoms and literals are sorted and made unique, while
+// duplicate weight literals are merged.
+struct DuplicateFilter::Data {
+	enum Tag { TagNormal = 0, TagSum = 2, TagMinimize = 4, TagOutput = 5 };
+	typedef SpanTable<Lit_t>         KeyTab;
+	typedef std::vector<Lit_t>       LitVec;
+	typedef std::vector<WeightLit_t> WLitVec;
+	void start(int tag, int x) {
+		key.clear();
+		key.push_back(tag);
+		key.push_back(x);
+	}
+	template <class T>
+	void addSet(const Span<T>& in) {
+		std::size_t n = key.size();
+		key.push_back(0);
+		key.insert(key.end(), begin(in), end(in));
+		Lit_t* k = &key[0];
+		key.resize(static_cast<std::size_t>(sortUnique(k + n + 1, k + key.size()) - k));
+		key[n] = static_cast<Lit_t>(key.size() - (n + 1));
+	}
+	void addMultiSet(const WeightLitSpan& in) {
+		wlits.assign(begin(in), end(in));
+		if (!wlits.empty()) {
+			WeightLit_t* w = &wlits[0];
+			wlits.resize(static_cast<std::size_t>(mergeDuplicates(w, w + wlits.size()) - w));
+		}
+		for (WLitVec::const_iterator it = wlits.begin(), end = wlits.end(); it != end; ++it) {
+			key.push_back(it->lit);
+			key.push_back(it->weight);
+		}
+	}
+	void addString(const StringSpan& str) {
+		std::size_t n = key.size();
+		key.resize(n + (str.size + sizeof(Lit_t) - 1) / sizeof(Lit_t), 0);
+		if (str.size) { std::memcpy(&key[n], str.first, str.size); }
+	}
+	bool insert() { return seen.insert(toSpan(key), 0).second; }
+	KeyTab  seen;
+	LitVec  key;
+	WLitVec wlits;
+};
+DuplicateFilter::DuplicateFilter(AbstractProgram& out, const Options& opts) : out_(out), data_(new Data), opts_(opts), dups_(0) {}
+DuplicateFilter::~DuplicateFilter() { delete data_; }
+void DuplicateFilter::initProgram(bool inc) { out_.initProgram(inc); }
+void DuplicateFilter::beginStep() { out_.beginStep(); }
+void DuplicateFilter::rule(Head_t ht, const AtomSpan& head, const LitSpan& body) {
+	data_->start(Data::TagNormal | static_cast<int>(ht), 0);
+	data_->addSet(head);
+	data_->addSet(body);
+	if (data_->insert()) { out_.rule(ht, head, body); }
+	else                 { ++dups_; }
+}
+void DuplicateFilter::rule(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& body) {
+	data_->start(Data::TagSum | static_cast<int>(ht), bound);
+	data_->addSet(head);
+	data_->addMultiSet(body);
+	if (data_->insert()) { out_.rule(ht, head, bound, body); }
+	else                 { ++dups_; }
+}
+void DuplicateFilter::minimize(Weight_t prio, const WeightLitSpan& lits) {
+	if (opts_.minimize) {
+		data_->start(Data::TagMinimize, prio);
+		data_->addMultiSet(lits);
+		if (!data_->insert()) { ++dups_; return; }
+	}
+	out_.minimize(prio, lits);
+}
+void DuplicateFilter::output(const StringSpan& str, const LitSpan& condition) {
+	data_->start(Data::TagOutput, static_cast<int>(str.size));
+	data_->addString(str);
+	data_->addSet(condition);
+	if (data_->insert()) { out_.output(str, condition); }
+	else                 { ++dups_; }
+}
+void DuplicateFilter::project(const AtomSpan& atoms) { out_.project(atoms); }
+void DuplicateFilter::external(Atom_t a, Value_t v) { out_.external(a, v); }
+void DuplicateFilter::assume(const LitSpan& lits) { out_.assume(lits); }
+void DuplicateFilter::heuristic(Atom_t a, Heuristic_t t, int bias, unsigned prio, const LitSpan& condition) {
+	out_.heuristic(a, t, bias, prio, condition);
+}
+void DuplicateFilter::acycEdge(int s, int t, const LitSpan& condition) { out_.acycEdge(s, t, condition); }
+void DuplicateFilter::theoryTerm(Id_t termId, int number) { out_.theoryTerm(termId, number); }
+void DuplicateFilter::theoryTerm(Id_t termId, const StringSpan& name) { out_.theoryTerm(termId, name); }
+void DuplicateFilter::theoryTerm(Id_t termId, int cId, const IdSpan& args) { out_.theoryTerm(termId, cId, args); }
+void DuplicateFilter::theoryElement(Id_t elementId, const IdSpan& terms, const LitSpan& cond) {
+	out_.theoryElement(elementId, terms, cond);
+}
+void DuplicateFilter::theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements) {
+	out_.theoryAtom(atomOrZero, termId, elements);
+}
+void DuplicateFilter::theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements, Id_t op, Id_t rhs) {
+	out_.theoryAtom(atomOrZero, termId, elements, op, rhs);
+}
+void DuplicateFilter::endStep() {
+	out_.endStep();
+	if (opts_.stepScope) { data_->seen.clear(); }
+}
+/////////////////////////////////////////////////////////////////////////////////////////
+// FactPropagator
+/////////////////////////////////////////////////////////////////////////////////////////
+struct FactPropagator::Data {
+	typedef PagedMap<uint64_t, 9>    FactSet;
+	typedef std::vector<Atom_t>      AtomVec;
+	typedef std::vector<Lit_t>       LitVec;
+	typedef std::vector<WeightLit_t> WLitVec;
+	enum State { Open = 0, Fact = 1, Removed = 2 };
+	// A buffered rule whose head and body are stored in atoms and wlits, respectively.
+	struct Rule {
+		uint32_t head, hLen;
+		uint32_t body, bLen;
+		int64_t  bound;
+		uint8_t  ht, sum, state;
+	};
+	// A buffered output directive whose name and condition are stored in names and lits.
+	struct Output {
+		uint32_t name, nLen;
+		uint32_t cond, cLen;
+	};
+	typedef std::vector<Rule>   RuleVec;
+	typedef std::vector<Output> OutVec;
+
+	bool isFact(Atom_t a) const { return (facts.get(a >> 6) & (uint64_t(1) << (a & 63))) != 0; }
+	bool isTrue(Lit_t x)  const { return x > 0 && isFact(atom(x)); }
+	bool isFalse(Lit_t x) const { return x < 0 && isFact(atom(x)); }
+	void setFact(Atom_t a)      { facts[a >> 6] |= uint64_t(1) << (a & 63); }
+
+	Data() : removed(0) {}
+	void addRule(Head_t ht, const AtomSpan& head, const WeightLitSpan& body, Weight_t bound, bool sum) {
+		Rule r;
+		r.head  = static_cast<uint32_t>(atoms.size());
+		r.hLen  = static_cast<uint32_t>(head.size);
+		r.body  = static_cast<uint32_t>(wlits.size());
+		r.bLen  = static_cast<uint32_t>(body.size);
+		r.bound = bound;
+		r.ht    = static_cast<uint8_t>(ht);
+		r.sum   = static_cast<uint8_t>(sum);
+		r.state = Open;
+		atoms.insert(atoms.end(), begin(head), end(head));
+		wlits.insert(wlits.end(), begin(body), end(body));
+		rules.push_back(r);
+		if (simplify(rules.back()) == Removed) { ++removed; }
+	}
+	// Simplifies r in place and returns its new state.
+	State simplify(Rule& r) {
+		Atom_t* h = r.hLen ? &atoms[r.head] : 0;
+		if (r.ht == Head_t::Disjunctive) {
+			for (uint32_t i = 0; i != r.hLen; ++i) {
+				if (isFact(h[i])) { return State(r.state = Removed); }
+			}
+		}
+		else {
+			uint32_t j = 0;
+			for (uint32_t i = 0; i != r.hLen; ++i) {
+				if (!isFact(h[i])) { h[j++] = h[i]; }
+			}
+			if ((r.hLen = j) == 0) { return State(r.state = Removed); }
+		}
+		WeightLit_t* b = r.bLen ? &wlits[r.body] : 0;
+		uint32_t j = 0;
+		int64_t minSum = 0, maxSum = 0;
+		for (uint32_t i = 0; i != r.bLen; ++i) {
+			if (isTrue(b[i].lit)) {
+				// keep the literal if removing it would move the bound out of the range of Weight_t
+				int64_t nb = r.bound - b[i].weight;
+				if (!r.sum || (nb >= INT_MIN && nb <= INT_MAX)) { r.bound = nb; continue; }
+				minSum += b[i].weight;
+				maxSum += b[i].weight;
+				b[j++] = b[i];
+			}
+			else if (isFalse(b[i].lit)) {
+				if (!r.sum) { return State(r.state = Removed); }
+			}
+			else {
+				(b[i].weight < 0 ? minSum : maxSum) += b[i].weight;
+				b[j++] = b[i];
+			}
+		}
+		r.bLen = j;
+		if (r.sum) {
+			if      (maxSum < r.bound) { return State(r.state = Removed); }
+			else if (minSum >= r.bound) { r.sum = 0; r.bLen = 0; }
+		}
+		if (r.ht == Head_t::Disjunctive && r.hLen == 1 && !r.sum && r.bLen == 0) {
+			setFact(h[0]);
+			return State(r.state = Fact);
+		}
+		return Open;
+	}
+	// Simplifies all open rules until no new fact is derived or at most n times.
+	void propagate(unsigned n) {
+		for (bool changed = true; changed && n--;) {
+			changed = false;
+			for (RuleVec::iterator it = rules.begin(), end = rules.end(); it != end; ++it) {
+				if (it->state != Open) { continue; }
+				State st = simplify(*it);
+				changed |= st == Fact;
+				removed += st == Removed;
+			}
+		}
+	}
+	void flush(AbstractProgram& out) {
+		for (RuleVec::const_iterator it = rules.begin(), end = rules.end(); it != end; ++it) {
+			if (it->state == Removed) { continue; }
+			AtomSpan head = toSpan(it->hLen ? &atoms[it->head] : 0, it->hLen);
+			WeightLitSpan body = toSpan(it->bLen ? &wlits[it->body] : 0, it->bLen);
+			if (it->sum) {
+				Weight_t bound = static_cast<Weight_t>(std::max(std::min(it->bound, static_cast<int64_t>(INT_MAX)), static_cast<int64_t>(INT_MIN)));
+				out.rule(static_cast<Head_t>(it->ht), head, bound, body);
+				continue;
+			}
+			lits.clear();
+			for (const WeightLit_t* x = begin(body), *xEnd = Potassco::end(body); x != xEnd; ++x) { lits.push_back(x->lit); }
+			out.rule(static_cast<Head_t>(it->ht), head, toSpan(lits));
+		}
+		for (OutVec::const_iterator it = outputs.begin(), end = outputs.end(); it != end; ++it) {
+			lits.clear();
+			bool isFalse = false;
+			for (uint32_t i = 0; i != it->cLen && !isFalse; ++i) {
+				Lit_t x = cond[it->cond + i];
+				isFalse = this->isFalse(x);
+				if (!isTrue(x)) { lits.push_back(x); }
+			}
+			if (isFalse) { ++removed; continue; }
+			out.output(toSpan(it->nLen ? &names[it->name] : 0, it->nLen), toSpan(lits));
+		}
+		RuleVec().swap(rules);
+		OutVec().swap(outputs);
+		AtomVec().swap(atoms);
+		WLitVec().swap(wlits);
+		LitVec().swap(cond);
+		std::string().swap(names);
+	}
+	FactSet     facts;
+	RuleVec     rules;
+	OutVec      outputs;
+	AtomVec     atoms;
+	WLitVec     wlits;
+	WLitVec     temp;
+	LitVec      cond;
+	LitVec      lits;
+	std::string names;
+	uint64_t    removed;
+};
+FactPropagator::FactPropagator(AbstractProgram& out, unsigned maxPasses) : out_(out), data_(new Data), passes_(maxPasses) {}
+FactPropagator::~FactPropagator() { delete data_; }
+void FactPropagator::initProgram(bool inc) { out_.initProgram(inc); }
+void FactPropagator::beginStep() { out_.beginStep(); }
+void FactPropagator::rule(Head_t ht, const AtomSpan& head, const LitSpan& body) {
+	data_->temp.clear();
+	for (const Lit_t* it = begin(body), *end = Potassco::end(body); it != end; ++it) {
+		WeightLit_t x = {*it, 1};
+		data_->temp.push_back(x);
+	}
+	data_->addRule(ht, head, toSpan(data_->temp), -1, false);
+}
+void FactPropagator::rule(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& body) {
+	data_->addRule(ht, head, body, bound, true);
+}
+void FactPropagator::output(const StringSpan& str, const LitSpan& condition) {
+	Data::Output o;
+	o.name = static_cast<uint32_t>(data_->names.size());
+	o.nLen = static_cast<uint32_t>(str.size);
+	o.cond = static_cast<uint32_t>(data_->cond.size());
+	o.cLen = static_cast<uint32_t>(condition.size);
+	data_->names.append(begin(str), str.size);
+	data_->cond.insert(data_->cond.end(), begin(condition), end(condition));
+	data_->outputs.push_back(o);
+}
+void FactPropagator::minimize(Weight_t prio, const WeightLitSpan& lits) { out_.minimize(prio, lits); }
+void FactPropagator::project(const AtomSpan& atoms) { out_.project(atoms); }
+void FactPropagator::external(Atom_t a, Value_t v) { out_.external(a, v); }
+void FactPropagator::assume(const LitSpan& lits) { out_.assume(lits); }
+void FactPropagator::heuristic(Atom_t a, Heuristic_t t, int bias, unsigned prio, const LitSpan& condition) {
+	out_.heuristic(a, t, bias, prio, condition);
+}
+void FactPropagator::acycEdge(int s, int t, const LitSpan& condition) { out_.acycEdge(s, t, condition); }
+void FactPropagator::theoryTerm(Id_t termId, int number) { out_.theoryTerm(termId, number); }
+void FactPropagator::theoryTerm(Id_t termId, const StringSpan& name) { out_.theoryTerm(termId, name); }
+void FactPropagator::theoryTerm(Id_t termId, int cId, const IdSpan& args) { out_.theoryTerm(termId, cId, args); }
+void FactPropagator::theoryElement(Id_t elementId, const IdSpan& terms, const LitSpan& cond) {
+	out_.theoryElement(elementId, terms, cond);
+}
+void FactPropagator::theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements) {
+	out_.theoryAtom(atomOrZero, termId, elements);
+}
+void FactPropagator::theoryAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elements, Id_t op, Id_t rhs) {
+	out_.theoryAtom(atomOrZero, termId, elements, op, rhs);
+}
+void FactPropagator::endStep() {
+	data_->propagate(passes_);
+	data_->flush(out_);
+	out_.endStep();
+}
+bool     FactPropagator::isFact(Atom_t a) const { return data_->isFact(a); }
+uint64_t FactPropagator::removed()        const { return data_->removed; }
+} // namespace Potassco
@@ -23,8 +23,11 @@
 //
 #include <potassco/rule_utils.h>
 #include <cstring>
+#include <climits>
+#include <cerrno>
 #include <stdexcept>
 #include <algorithm>
+#include <vector>
 namespace Potassco {
 Rule_t Rule_t::normal(Head_t ht, const AtomSpan& head, const LitSpan& body) {
 	Rule_t r = {ht, head, Body_t::Normal, {body}};
@@ -40,19 +43,162 @@ Rule_t Rule_t::sum(Head_t ht, const AtomSpan& head, Weight_t bound, const Weight
 	return sum(ht, head, s);
 }
 /////////////////////////////////////////////////////////////////////////////////////////
+// Normalization
+/////////////////////////////////////////////////////////////////////////////////////////
+namespace {
+// Sort key of a literal: atom in the upper bits, sign in the lowest bit.
+inline uint32_t litKey(Lit_t x) { return (static_cast<uint32_t>(atom(x)) << 1) | static_cast<uint32_t>(x < 0); }
+struct AtomKey { uint32_t operator()(Atom_t x) const { return x; } };
+struct LitKey  { uint32_t operator()(Lit_t x) const { return litKey(x); } };
+struct WLitKey { uint32_t operator()(const WeightLit_t& x) const { return litKey(x.lit); } };
+template <class K>
+struct ByKey {
+	template <class T>
+	bool operator()(const T& lhs, const T& rhs) const { return K()(lhs) < K()(rhs); }
+};
+// Stable LSD radix sort with 11-bit digits.
+template <class T, class K>
+void radixSort(T* first, T* last, K key) {
+	enum { BITS = 11, DIGITS = 1u << BITS, MASK = DIGITS - 1 };
+	std::size_t n = static_cast<std::size_t>(last - first);
+	std::vector<T> temp(n);
+	T* in = first, *out = &temp[0];
+	std::size_t count[DIGITS];
+	for (unsigned shift = 0; shift < 32; shift += BITS) {
+		std::memset(count, 0, sizeof(count));
+		for (const T* it = in; it != in + n; ++it) { ++count[(key(*it) >> shift) & MASK]; }
+		if (count[(key(*in) >> shift) & MASK] == n) { continue; }
+		for (std::size_t i = 0, sum = 0; i != DIGITS; ++i) {
+			std::size_t c = count[i];
+			count[i] = sum;
+			sum += c;
+		}
+		for (const T* it = in; it != in + n; ++it) { out[count[(key(*it) >> shift) & MASK]++] = *it; }
+		std::swap(in, out);
+	}
+	if (in != first) { std::copy(in, in + n, first); }
+}
+template <class T, class K>
+void sortByKey(T* first, T* last, K key) {
+	enum { SMALL_SIZE = 16, RADIX_SIZE = 1024 };
+	T* it = first;
+	if (it != last) {
+		while (++it != last && !(key(*it) < key(*(it - 1)))) { ; }
+	}
+	if (it == last) {
+		return; // already sorted
+	}
+	std::size_t n = static_cast<std::size_t>(last - first);
+	if (n <= SMALL_SIZE) {
+		for (it = first + 1; it != last; ++it) {
+			T x = *it;
+			T* j = it;
+			for (uint32_t k = key(x); j != first && k < key(*(j - 1)); --j) { *j = *(j - 1); }
+			*j = x;
+		}
+	}
+	else if (n < RADIX_SIZE) {
+		std::sort(first, last, ByKey<K>());
+	}
+	else {
+		radixSort(first, last, key);
+	}
+}
+}
+Atom_t* sortUnique(Atom_t* first, Atom_t* last) {
+	sortByKey(first, last, AtomKey());
+	return std::unique(first, last);
+}
+Lit_t* sortUnique(Lit_t* first, Lit_t* last) {
+	sortByKey(first, last, LitKey());
+	return std::unique(first, last);
+}
+bool hasComplement(const Lit_t* first, const Lit_t* last) {
+	if (first == last) { return false; }
+	for (const Lit_t* next = first + 1; next != last; first = next++) {
+		if (*next == -*first) { return true; }
+	}
+	return false;
+}
+WeightLit_t* mergeDuplicates(WeightLit_t* first, WeightLit_t* last) {
+	sortByKey(first, last, WLitKey());
+	WeightLit_t* out = first;
+	for (WeightLit_t* it = first; it != last;) {
+		WeightLit_t x = *it;
+		int64_t     w = x.weight;
+		while (++it != last && it->lit == x.lit) { w += it->weight; }
+		// split sums exceeding the range of Weight_t - this never needs more literals than were merged
+		for (x.weight = INT_MAX; w > INT_MAX; w -= INT_MAX) { *out++ = x; }
+		for (x.weight = INT_MIN; w < INT_MIN; w -= INT_MIN) { *out++ = x; }
+		if (w) { x.weight = static_cast<Weight_t>(w); *out++ = x; }
+	}
+	return out;
+}
+WeightLit_t* normalizeSum(WeightLit_t* first, WeightLit_t* last, Weight_t& bound) {
+	sortByKey(first, last, WLitKey());
+	int64_t      bnd = bound, total = 0;
+	WeightLit_t* out = first;
+	for (WeightLit_t* it = first; it != last;) {
+		// Sum up the (positive) weights of p and ~p, which are adjacent after sorting.
+		Atom_t  a    = atom(*it);
+		int64_t w[2] = {0, 0};
+		for (; it != last && atom(*it) == a; ++it) {
+			int64_t x = it->weight;
+			bool    n = it->lit < 0;
+			if (x < 0) {
+				n    = !n;
+				x    = -x;
+				bnd += x;
+			}
+			w[n] += x;
+		}
+		// Exactly one of p and ~p is true: the smaller weight is always counted.
+		int64_t m = std::min(w[0], w[1]);
+		bnd  -= m;
+		w[0] -= m;
+		w[1] -= m;
+		if (w[0] || w[1]) {
+			bool n = w[1] != 0;
+			// weights are clamped to the bound below, so INT_MAX is a safe intermediate cap
+			WeightLit_t x = {n ? neg(a) : lit(a), static_cast<Weight_t>(std::min(w[n], static_cast<int64_t>(INT_MAX)))};
+			total += w[n];
+			*out++ = x;
+		}
+	}
+	if (bnd <= 0) {
+		bound = static_cast<Weight_t>(std::max(bnd, static_cast<int64_t>(INT_MIN)));
+		return out;
+	}
+	if (bnd > INT_MAX) {
+		// The sum can only be represented if it is unsatisfiable.
+		POTASSCO_CHECK(total < bnd, EOVERFLOW, "sum bound out of range");
+		bound = 1;
+		return first;
+	}
+	// A weight that reaches the bound is equivalent to the bound.
+	bound = static_cast<Weight_t>(bnd);
+	for (WeightLit_t* it = first; it != out; ++it) {
+		if (it->weight == INT_MAX) { it->weight = bound; }
+	}
+	return out;
+}
+/////////////////////////////////////////////////////////////////////////////////////////
 // RuleBuilder
 /////////////////////////////////////////////////////////////////////////////////////////
+// Offsets are not limited to 32-bit because the header exists only once per builder
+// and rules with huge bodies (e.g. large minimize statements) are not uncommon.
 struct RuleBuilder::Rule {
+	typedef std::size_t Offset;
 	Rule() { head.init(0, 0); body.init(0, 0); top = sizeof(Rule); fix = 0; }
 	struct Span {
-		void init(uint32_t p, uint32_t t) { mbeg = mend = p; type = t; }
-		uint32_t mbeg:30;
-		uint32_t type: 2;
-		uint32_t mend;
-		uint32_t len() const { return mend - mbeg; }
+		void init(Offset p, uint32_t t) { mbeg = mend = p; type = t; }
+		Offset   mbeg;
+		Offset   mend;
+		uint32_t type;
+		Offset   len() const { return mend - mbeg; }
 	};
-	uint32_t top:31;
-	uint32_t fix: 1;
+	Offset   top;
+	uint32_t fix;
 	Span     head;
 	Span     body;
 };
@@ -64,7 +210,7 @@ inline Potassco::Span<T> span_cast(const MemoryRegion& m, const RuleBuilder::Rul
 template <class T>
 inline RuleBuilder::Rule* push(MemoryRegion& m, RuleBuilder::Rule* r, const T& what) {
 	assert(r == m.begin());
-	uint32_t t = r->top, nt = t + sizeof(T);
+	RuleBuilder::Rule::Offset t = r->top, nt = t + sizeof(T);
 	if (nt > m.size()) {
 		m.grow(nt);
 		r = static_cast<RuleBuilder::Rule*>(m.begin());
@@ -74,13 +220,13 @@ inline RuleBuilder::Rule* push(MemoryRegion& m, RuleBuilder::Rule* r, const T& w
 	return r;
 }
 }
-RuleBuilder::RuleBuilder() : mem_(64) {
+RuleBuilder::RuleBuilder(Allocator* alloc) : mem_(128, alloc) {
 	new (mem_.begin()) Rule();
 }
 RuleBuilder::Rule* RuleBuilder::rule_() const {
 	return static_cast<Rule*>(mem_.begin());
 }
-RuleBuilder::RuleBuilder(const RuleBuilder& other) {
+RuleBuilder::RuleBuilder(const RuleBuilder& other) : mem_(0, &other.mem_.allocator()) {
 	mem_.grow(other.rule_()->top);
 	std::memcpy(mem_.begin(), other.mem_.begin(), other.rule_()->top);
 }
@@ -123,9 +269,14 @@ RuleBuilder& RuleBuilder::addHead(Atom_t a) {
 	r->head.mend = r->top;
 	return *this;
 }
+RuleBuilder& RuleBuilder::reserve(std::size_t numHead, std::size_t numBody) {
+	Rule* r = rule_();
+	mem_.grow(r->top + numHead * sizeof(Atom_t) + numBody * sizeof(WeightLit_t) + sizeof(Weight_t));
+	return *this;
+}
 RuleBuilder& RuleBuilder::clearHead() {
 	Rule* r = unfreeze(false);
-	r->top = std::max(r->body.mend, static_cast<uint32_t>(sizeof(Rule)));
+	r->top = std::max(r->body.mend, static_cast<Rule::Offset>(sizeof(Rule)));
 	r->head.init(0, 0);
 	return *this;
 }
@@ -172,7 +323,7 @@ RuleBuilder& RuleBuilder::setBound(Weight_t bound) {
 }
 RuleBuilder& RuleBuilder::clearBody() {
 	Rule* r = unfreeze(false);
-	r->top = std::max(r->head.mend, static_cast<uint32_t>(sizeof(Rule)));
+	r->top = std::max(r->head.mend, static_cast<Rule::Offset>(sizeof(Rule)));
 	r->body.init(0, 0);
 	return *this;
 }
@@ -181,7 +332,7 @@ RuleBuilder& RuleBuilder::weaken(Body_t to, bool w) {
 	if (r->body.type == Body_t::Normal || r->body.type == to) { return *this; }
 	WeightLit_t* bIt = wlits_begin(), *bEnd = wlits_end();
 	if (to == Body_t::Normal) {
-		uint32_t i = r->body.mbeg - sizeof(Weight_t);
+		Rule::Offset i = r->body.mbeg - sizeof(Weight_t);
 		r->body.init(i, 0);
 		for (; bIt != bEnd; ++bIt, i += sizeof(Lit_t)) {
 			new (mem_[i])Lit_t(bIt->lit);
@@ -200,6 +351,42 @@ RuleBuilder& RuleBuilder::weaken(Body_t to, bool w) {
 	r->body.type = to;
 	return *this;
 }
+RuleBuilder::BodyState RuleBuilder::normalize() {
+	Rule* r = rule_();
+	BodyState st = BodyOpen;
+	if (r->head.type != Directive_t::Minimize) {
+		Atom_t* hEnd = sortUnique(head_begin(), head_end());
+		r->head.mend = r->head.mbeg + static_cast<Rule::Offset>(hEnd - head_begin()) * sizeof(Atom_t);
+	}
+	if (r->body.type == Body_t::Normal) {
+		Lit_t* bEnd = sortUnique(lits_begin(), lits_end());
+		r->body.mend = r->body.mbeg + static_cast<Rule::Offset>(bEnd - lits_begin()) * sizeof(Lit_t);
+		if      (hasComplement(lits_begin(), lits_end())) { st = BodyFalse; }
+		else if (lits_begin() == lits_end())              { st = BodyTrue; }
+	}
+	else {
+		WeightLit_t* bEnd;
+		if (r->head.type == Directive_t::Minimize) {
+			bEnd = mergeDuplicates(wlits_begin(), wlits_end());
+		}
+		else {
+			Weight_t bnd = bound();
+			bEnd = normalizeSum(wlits_begin(), wlits_end(), bnd);
+			std::memcpy(bound_(), &bnd, sizeof(Weight_t));
+			int64_t total = 0;
+			for (const WeightLit_t* it = wlits_begin(); it != bEnd; ++it) {
+				total += it->weight;
+				if (it->weight != 1) { r->body.type = Body_t::Sum; }
+			}
+			if      (bnd <= 0)    { st = BodyTrue; }
+			else if (total < bnd) { st = BodyFalse; }
+		}
+		r->body.mend = r->body.mbeg + static_cast<Rule::Offset>(bEnd - wlits_begin()) * sizeof(WeightLit_t);
+	}
+	r->top = std::max(std::max(r->head.mend, r->body.mend), static_cast<Rule::Offset>(sizeof(Rule)));
+	return st;
+}
+bool         RuleBuilder::isMinimize() const { return rule_()->head.type == Directive_t::Minimize; }
 Body_t       RuleBuilder::bodyType()   const { return static_cast<Body_t>(rule_()->body.type); }
 LitSpan      RuleBuilder::body()       const { return span_cast<Lit_t>(mem_, rule_()->body); }
 Lit_t*       RuleBuilder::lits_begin() const { return static_cast<Lit_t*>(mem_[rule_()->body.mbeg]); }
@@ -241,5 +428,95 @@ Rule_t RuleBuilder::rule() const {
 	}
 	return ret;
 }
+/////////////////////////////////////////////////////////////////////////////////////////
+// RuleBatch
+/////////////////////////////////////////////////////////////////////////////////////////
+// Each rule is stored as a header followed by its head atoms and its body elements.
+struct RuleBatch::Header {
+	uint32_t ht  :  1;
+	uint32_t bt  :  2;
+	uint32_t min :  1;
+	uint32_t hLen: 28;
+	uint32_t bLen;
+	Weight_t bound;
+};
+RuleBatch::RuleBatch(Allocator* alloc) : mem_(0, alloc), top_(0) {}
+RuleBatch::~RuleBatch() {}
+void RuleBatch::swap(RuleBatch& other) {
+	mem_.swap(other.mem_);
+	std::swap(top_, other.top_);
+	offsets_.swap(other.offsets_);
+}
+RuleBatch& RuleBatch::clear() {
+	top_ = 0;
+	offsets_.clear();
+	return *this;
+}
+void* RuleBatch::push(Header h, std::size_t bytes) {
+	std::size_t n = top_ + sizeof(Header) + bytes;
+	if (n > mem_.size()) {
+		mem_.grow(std::max(n, mem_.size() * 2));
+	}
+	offsets_.push_back(top_);
+	new (mem_[top_]) Header(h);
+	void* data = mem_[top_ + sizeof(Header)];
+	top_ = n;
+	return data;
+}
+RuleBatch::Header* RuleBatch::header(uint32_t i) const {
+	return static_cast<Header*>(mem_[offsets_[i]]);
+}
+RuleBatch& RuleBatch::add(Head_t ht, const AtomSpan& head, const LitSpan& body) {
+	POTASSCO_REQUIRE(head.size < (1u << 28), "too many head atoms");
+	Header h = {static_cast<uint32_t>(ht), Body_t::Normal, 0, static_cast<uint32_t>(head.size), static_cast<uint32_t>(body.size), -1};
+	unsigned char* data = static_cast<unsigned char*>(push(h, head.size * sizeof(Atom_t) + body.size * sizeof(Lit_t)));
+	if (head.size) { std::memcpy(data, head.first, head.size * sizeof(Atom_t)); }
+	if (body.size) { std::memcpy(data + head.size * sizeof(Atom_t), body.first, body.size * sizeof(Lit_t)); }
+	return *this;
+}
+RuleBatch& RuleBatch::add(Head_t ht, const AtomSpan& head, Weight_t bound, const WeightLitSpan& body) {
+	Rule_t r = Rule_t::sum(ht, head, bound, body);
+	return add(r);
+}
+RuleBatch& RuleBatch::add(const Rule_t& r) {
+	if (r.normal()) { return add(r.ht, r.head, r.cond); }
+	POTASSCO_REQUIRE(r.head.size < (1u << 28), "too many head atoms");
+	Header h = {static_cast<uint32_t>(r.ht), static_cast<uint32_t>(r.bt), 0, static_cast<uint32_t>(r.head.size), static_cast<uint32_t>(r.agg.lits.size), r.agg.bound};
+	unsigned char* data = static_cast<unsigned char*>(push(h, r.head.size * sizeof(Atom_t) + r.agg.lits.size * sizeof(WeightLit_t)));
+	if (r.head.size)     { std::memcpy(data, r.head.first, r.head.size * sizeof(Atom_t)); }
+	if (r.agg.lits.size) { std::memcpy(data + r.head.size * sizeof(Atom_t), r.agg.lits.first, r.agg.lits.size * sizeof(WeightLit_t)); }
+	return *this;
+}
+RuleBatch& RuleBatch::addMinimize(Weight_t prio, const WeightLitSpan& lits) {
+	Rule_t r = Rule_t::sum(Head_t::Disjunctive, toSpan<Atom_t>(), prio, lits);
+	add(r);
+	header(size() - 1)->min = 1;
+	return *this;
+}
+RuleBatch& RuleBatch::add(const RuleBuilder& rb) {
+	return rb.isMinimize() ? addMinimize(rb.bound(), rb.sum().lits) : add(rb.rule());
+}
+Rule_t RuleBatch::rule(uint32_t i) const {
+	const Header* h = header(i);
+	const Atom_t* head = reinterpret_cast<const Atom_t*>(h + 1);
+	Rule_t r;
+	r.ht   = static_cast<Head_t>(h->ht);
+	r.head = toSpan(head, h->hLen);
+	r.bt   = static_cast<Body_t>(h->bt);
+	if (r.bt == Body_t::Normal) {
+		r.cond = toSpan(reinterpret_cast<const Lit_t*>(head + h->hLen), h->bLen);
+	}
+	else {
+		r.agg.lits  = toSpan(reinterpret_cast<const WeightLit_t*>(head + h->hLen), h->bLen);
+		r.agg.bound = h->bound;
+	}
+	return r;
+}
+bool RuleBatch::isMinimize(uint32_t i) const {
+	return header(i)->min != 0;
+}
+void RuleBatch::emit(AbstractProgram& out) const {
+	out.rules(*this);
+}
 
 } // namespace Potassco
@@ -23,13 +23,15 @@
 //
 #include <potassco/smodels.h>
 #include <potassco/rule_utils.h>
+#include <potassco/span_table.h>
+#include "parallel.h"
 #include <ostream>
 #include <string>
 #include <cstring>
 #include <vector>
-#include POTASSCO_EXT_INCLUDE(unordered_map)
-typedef POTASSCO_EXT_NS::unordered_map<std::string, Potassco::Id_t> StrMap;
+#include <algorithm>
 namespace Potassco {
+typedef SpanTable<char> StrTab;
 
 enum SmodelsRule {
 	End         = 0,
@@ -58,33 +60,70 @@ AtomTable::~AtomTable() {}
 struct SmodelsInput::SymTab : public AtomTable{
 	SymTab(AbstractProgram& o) : out(&o) {}
 	virtual void add(Atom_t id, const StringSpan& name, bool output) {
-		atoms.insert(StrMap::value_type(std::string(Potassco::begin(name), Potassco::end(name)), id));
+		add(id, name, StrTab::hash(name), output);
+	}
+	virtual Atom_t find(const StringSpan& name) {
+		return find(name, StrTab::hash(name));
+	}
+	void add(Atom_t id, const StringSpan& name, uint32_t h, bool output) {
+		atoms.insert(name, h, id);
 		if (output) {
 			Lit_t lit = static_cast<Lit_t>(id);
 			out->output(name, toSpan(&lit, 1));
 		}
 	}
-	virtual Atom_t find(const StringSpan& name) {
-		temp.assign(Potassco::begin(name), Potassco::end(name));
-		StrMap::const_iterator it = atoms.find(temp);
-		return it != atoms.end() ? it->second : 0;
+	Atom_t find(const StringSpan& name, uint32_t h) const {
+		const StrTab::Entry* e = atoms.find(name, h);
+		return e ? e->value : 0;
 	}
-	struct Heuristic {
-		std::string atom;
-		Heuristic_t type;
-		int         bias;
-		unsigned    prio;
-		Lit_t       cond;
-	};
-	StrMap           atoms;
-	std::string      temp;
+	StrTab           atoms;
 	AbstractProgram* out;
 };
 struct SmodelsInput::NodeTab {
-	Id_t add(const StringSpan& n) {
-		return nodes.insert(StrMap::value_type(std::string(begin(n), end(n)), (Id_t)nodes.size())).first->second;
+	Id_t add(const StringSpan& n, uint32_t h) {
+		return nodes.insert(n, h, nodes.size()).first->value;
+	}
+	StrTab nodes;
+};
+// An entry of the symbol table.
+struct SmodelsInput::Symbol {
+	enum Type { Output = 0, Edge = 1, Heuristic = 2 };
+	// Determines the type of this symbol and precomputes hash values for the table lookups.
+	void classify(const Options& opts, bool hashName) {
+		const char* n = name.first;
+		type = Output;
+		if (opts.cEdge && matchEdgePred(n, n0, n1) > 0) {
+			type  = Edge;
+			h0 = StrTab::hash(n0);
+			h1 = StrTab::hash(n1);
+		}
+		else if (opts.cHeuristic && matchDomHeuPred(n, n0, heuType, bias, prio) > 0) {
+			type  = Heuristic;
+			h0 = StrTab::hash(n0);
+		}
+		if (hashName) { hash = StrTab::hash(name); }
 	}
-	StrMap nodes;
+	Lit_t       atom;
+	Type        type;
+	StringSpan  name;
+	StringSpan  n0, n1;       // nodes of edge or atom of heuristic
+	uint32_t    hash, h0, h1; // hash values of name, n0, and n1
+	Heuristic_t heuType;
+	int         bias;
+	unsigned    prio;
+};
+// Classifies a part of the symbols of a step.
+struct SmodelsInput::ClassifySymbols {
+	// Minimal number of symbols per thread.
+	enum { MIN_SYMBOLS = 4096 };
+	void operator()(unsigned i) const {
+		std::size_t b = (syms->size() * i) / n, e = (syms->size() * (i + 1)) / n;
+		for (; b != e; ++b) { (*syms)[b].classify(*opts, hashName); }
+	}
+	SymbolVec*     syms;
+	const Options* opts;
+	unsigned       n;
+	bool           hashName;
 };
 SmodelsInput::SmodelsInput(AbstractProgram& out, const Options& opts, AtomTable* syms) : out_(out), atoms_(syms), nodes_(0), opts_(opts), delSyms_(false) {}
 SmodelsInput::~SmodelsInput() { if (delSyms_) delete atoms_; delete nodes_; }
@@ -182,40 +221,60 @@ bool SmodelsInput::readRules() {
 	return true;
 }
 
+bool SmodelsInput::matchSymbol(Symbol& sym, std::string& temp) {
+	if ((sym.atom = (Lit_t)matchPos()) == 0) { return false; }
+	stream()->get();
+	return require(stream()->readLine(sym.name, temp), "atom name expected!");
+}
+void SmodelsInput::addSymbol(const Symbol& sym, Arena& mem, SymbolVec& doms) {
+	bool filter = false;
+	if (sym.type == Symbol::Edge) {
+		Id_t s = nodes_->add(sym.n0, sym.h0);
+		Id_t t = nodes_->add(sym.n1, sym.h1);
+		out_.acycEdge(static_cast<int>(s), static_cast<int>(t), toSpan(&sym.atom, 1));
+		filter = opts_.filter;
+	}
+	else if (sym.type == Symbol::Heuristic) {
+		// atom is resolved once the whole symbol table is known
+		doms.push_back(sym);
+		doms.back().n0 = toSpan(mem.copy(begin(sym.n0), size(sym.n0)), size(sym.n0));
+		filter = opts_.filter;
+	}
+	if      (delSyms_) { static_cast<SymTab*>(atoms_)->add(sym.atom, sym.name, sym.hash, !filter); }
+	else if (atoms_)   { atoms_->add(sym.atom, sym.name, !filter); }
+	else if (!filter)  { out_.output(sym.name, toSpan(&sym.atom, 1)); }
+}
 bool SmodelsInput::readSymbols() {
-	std::string name;
+	std::string temp;
 	if (opts_.cEdge && !nodes_) { nodes_ = new NodeTab; }
 	if (opts_.cHeuristic && !atoms_) { atoms_ = new SymTab(out_); delSyms_ = true; }
-	StringSpan n0, n1;
-	SymTab::Heuristic heu;
-	std::vector<SymTab::Heuristic> doms;
-	for (Lit_t atom; (atom = (Lit_t)matchPos()) != 0;) {
-		name.clear();
-		stream()->get();
-		for (char c; (c = stream()->get()) != '\n';) {
-			require(c != 0, "atom name expected!");
-			name += c;
+	Arena     mem;
+	SymbolVec doms;
+	Symbol    sym;
+	if (detail::numThreads(opts_.threads) == 1) {
+		while (matchSymbol(sym, temp)) {
+			sym.classify(opts_, delSyms_);
+			addSymbol(sym, mem, doms);
 		}
-		const char* n = name.c_str();
-		bool filter = false;
-		if (opts_.cEdge && matchEdgePred(n, n0, n1) > 0) {
-			Id_t s = nodes_->add(n0);
-			Id_t t = nodes_->add(n1);
-			out_.acycEdge(static_cast<int>(s), static_cast<int>(t), toSpan(&atom, 1));
-			filter = opts_.filter;
+	}
+	else {
+		// read whole symbol table, classify in parallel, and add symbols in original order
+		SymbolVec syms;
+		while (matchSymbol(sym, temp)) {
+			sym.name = toSpan(mem.copy(begin(sym.name), size(sym.name)), size(sym.name));
+			syms.push_back(sym);
 		}
-		else if (opts_.cHeuristic && matchDomHeuPred(n, n0, heu.type, heu.bias, heu.prio) > 0) {
-			heu.cond = atom;
-			heu.atom.assign(Potassco::begin(n0), Potassco::end(n0));
-			doms.push_back(heu);
-			filter = opts_.filter;
+		unsigned n = detail::numThreads(opts_.threads), max = static_cast<unsigned>(syms.size() / ClassifySymbols::MIN_SYMBOLS);
+		ClassifySymbols classify = {&syms, &opts_, std::max(std::min(n, max), 1u), delSyms_};
+		detail::parallelFor(classify.n, classify);
+		for (SymbolVec::const_iterator it = syms.begin(), end = syms.end(); it != end; ++it) {
+			addSymbol(*it, mem, doms);
 		}
-		if      (atoms_)  { atoms_->add(atom, toSpan(name), !filter); }
-		else if (!filter) { out_.output(toSpan(name), toSpan(&atom, 1)); }
 	}
-	for (std::vector<SymTab::Heuristic>::const_iterator it = doms.begin(), end = doms.end(); it != end; ++it) {
-		if (Atom_t x = atoms_->find(toSpan(it->atom))) {
-			out_.heuristic(x, it->type, it->bias, it->prio, toSpan(&it->cond, 1));
+	for (SymbolVec::const_iterator it = doms.begin(), end = doms.end(); it != end; ++it) {
+		Atom_t x = delSyms_ ? static_cast<SymTab*>(atoms_)->find(it->n0, it->h0) : atoms_->find(it->n0);
+		if (x) {
+			out_.heuristic(x, it->heuType, it->bias, it->prio, toSpan(&it->atom, 1));
 		}
 	}
 	if (!incremental()) {
@@ -22,35 +22,40 @@
 // IN THE SOFTWARE.
 //
 #include <potassco/theory_data.h>
+#include <potassco/arena.h>
+#include <potassco/span_table.h>
+#include <potassco/paged_map.h>
+#include "parallel.h"
+#if POTASSCO_HAS_THREADS
+#include <atomic>
+#endif
 #include <memory>
 #include <stdexcept>
 #include <algorithm>
 #include <cstring>
+#include <ostream>
+#include <vector>
 namespace Potassco {
 template <class T>
 static std::size_t nBytes(const IdSpan& ids) {
 	return sizeof(T) + (ids.size * sizeof(Id_t));
 }
 struct FuncData {
-	static FuncData* newFunc(int32_t base, const IdSpan& args);
-	static void destroy(FuncData*);
+	static FuncData* newFunc(Arena& mem, int32_t base, const IdSpan& args);
 	int32_t  base;
 	uint32_t size;
 POTASSCO_WARNING_BEGIN_RELAXED
 	Id_t     args[0];
 POTASSCO_WARNING_END_RELAXED
 };
-FuncData* FuncData::newFunc(int32_t base, const IdSpan& args) {
+FuncData* FuncData::newFunc(Arena& mem, int32_t base, const IdSpan& args) {
 	std::size_t nb = nBytes<FuncData>(args);
-	FuncData* f = new (::operator new(nb)) FuncData;
+	FuncData* f = new (mem.allocate(nb, Arena::alignOf<Id_t>())) FuncData;
 	f->base = base;
 	f->size = static_cast<uint32_t>(Potassco::size(args));
 	std::memcpy(f->args, begin(args), f->size * sizeof(Id_t));
 	return f;
 }
-void FuncData::destroy(FuncData* f) {
-	if (f) { f->~FuncData(); ::operator delete(f); }
-}
 const uint64_t nulTerm  = static_cast<uint64_t>(-1);
 const uint64_t typeMask = static_cast<uint64_t>(3);
 
@@ -105,15 +110,16 @@ TheoryElement::TheoryElement(const IdSpan& terms, Id_t c) : nTerms_(static_cast<
 	std::memcpy(term_, Potassco::begin(terms), nTerms_ * sizeof(Id_t));
 	if (nCond_ != 0) { term_[nTerms_] = c; }
 }
-TheoryElement* TheoryElement::newElement(const IdSpan& terms, Id_t c) {
+TheoryElement* TheoryElement::newElement(const IdSpan& terms, Id_t c, Allocator* alloc) {
 	std::size_t nb = nBytes<TheoryElement>(terms);
 	if (c != 0) { nb += sizeof(Id_t); }
-	return new (::operator new(nb)) TheoryElement(terms, c);
+	return new (allocatorOrDefault(alloc).allocate(nb)) TheoryElement(terms, c);
 }
-void TheoryElement::destroy(TheoryElement* e) {
+void TheoryElement::destroy(TheoryElement* e, Allocator* alloc) {
 	if (e) {
+		std::size_t nb = sizeof(TheoryElement) + ((e->nTerms_ + e->nCond_) * sizeof(Id_t));
 		e->~TheoryElement();
-		::operator delete(e);
+		allocatorOrDefault(alloc).deallocate(e, nb);
 	}
 }
 Id_t TheoryElement::condition() const {
@@ -135,17 +141,18 @@ TheoryAtom::TheoryAtom(Id_t a, Id_t term, const IdSpan& args, Id_t* op, Id_t* rh
 	}
 }
 
-TheoryAtom* TheoryAtom::newAtom(Id_t a, Id_t term, const IdSpan& args) {
-	return new (::operator new(nBytes<TheoryAtom>(args))) TheoryAtom(a, term, args, 0, 0);
+TheoryAtom* TheoryAtom::newAtom(Id_t a, Id_t term, const IdSpan& args, Allocator* alloc) {
+	return new (allocatorOrDefault(alloc).allocate(nBytes<TheoryAtom>(args))) TheoryAtom(a, term, args, 0, 0);
 }
-TheoryAtom* TheoryAtom::newAtom(Id_t a, Id_t term, const IdSpan& args, Id_t op, Id_t rhs) {
+TheoryAtom* TheoryAtom::newAtom(Id_t a, Id_t term, const IdSpan& args, Id_t op, Id_t rhs, Allocator* alloc) {
 	std::size_t nb = nBytes<TheoryAtom>(args) + (2*sizeof(Id_t));
-	return new (::operator new(nb)) TheoryAtom(a, term, args, &op, &rhs);
+	return new (allocatorOrDefault(alloc).allocate(nb)) TheoryAtom(a, term, args, &op, &rhs);
 }
-void TheoryAtom::destroy(TheoryAtom* a) {
+void TheoryAtom::destroy(TheoryAtom* a, Allocator* alloc) {
 	if (a) {
+		std::size_t nb = sizeof(TheoryAtom) + ((a->nTerms_ + (2 * a->guard_)) * sizeof(Id_t));
 		a->~TheoryAtom();
-		::operator delete(a);
+		allocatorOrDefault(alloc).deallocate(a, nb);
 	}
 }
 const Id_t* TheoryAtom::guard() const {
@@ -157,10 +164,19 @@ const Id_t* TheoryAtom::rhs() const {
 //////////////////////////////////////////////////////////////////////////////////////////////////////
 // TheoryData
 //////////////////////////////////////////////////////////////////////////////////////////////////////
+// Returns a new term version that is unique among all TheoryData objects of the process.
+static uint32_t nextVersion() {
+#if POTASSCO_HAS_THREADS
+	static std::atomic<uint32_t> version(0);
+#else
+	static uint32_t version = 0;
+#endif
+	return ++version;
+}
 struct TheoryData::Data {
 	template <class T>
 	struct RawStack {
-		RawStack() : top(0) {}
+		explicit RawStack(Allocator& a) : mem(0, &a), top(0) {}
 		void push(const T& x = T()) {
 			mem.grow(top += sizeof(T));
 			new (mem[top-sizeof(T)])T(x);
@@ -172,116 +188,248 @@ struct TheoryData::Data {
 		MemoryRegion mem;
 		std::size_t  top;
 	};
+	// Maps (possibly sparse) ids to values of type T and tracks one past the largest id written.
+	template <class T>
+	struct IdTable {
+		typedef PagedMap<T, 10> Map;
+		enum { PAGE_MASK = Map::PAGE_MASK };
+		explicit IdTable(Allocator& a) : map(T(), &a), end(0) {}
+		// Returns the slot of the given id or 0 if no such slot exists.
+		const T* find(Id_t id) const { return map.find(id); }
+		T*       find(Id_t id)       { return map.find(id); }
+		// Returns the slot of the given id, which is created if necessary.
+		T& operator[](Id_t id) {
+			POTASSCO_REQUIRE(id != UINT32_MAX, "Id '%u' out of range", id);
+			if (id >= end) { end = id + 1; }
+			return map[id];
+		}
+		uint32_t size() const { return end; }
+		void     reset()      { map.clear(); end = 0; }
+		Map      map;
+		uint32_t end;
+	};
 	RawStack<TheoryAtom*>    atoms;
-	RawStack<TheoryElement*> elems;
-	RawStack<TheoryTerm>     terms;
+	IdTable<TheoryElement*>  elems;
+	IdTable<TheoryTerm>      terms;
 	struct Up {
 		Up() : atom(0), term(0), elem(0) {}
 		uint32_t atom;
 		uint32_t term;
 		uint32_t elem;
 	} frame;
-};
-struct TheoryData::DestroyT {
-	template <class T> void operator()(T* x) const { return T::destroy(x); }
-	void operator()(TheoryTerm& t) const {
-		if (t.valid()) {
-			if (t.type() == Theory_t::Compound) {
-				this->operator()(t.func());
-			}
-			else if (t.type() == Theory_t::Symbol) {
-				delete[] const_cast<char*>(t.symbol());
-			}
+	// Optional hash-consing of terms and elements.
+	// The table maps structural keys to the id of the first term or element with
+	// that key; the canonical id tables store the representative + 1 of terms and
+	// elements that are duplicates, i.e. 0 means that an id is its own representative.
+	struct Share {
+		static const Id_t noId = static_cast<Id_t>(-1);
+		explicit Share(Allocator& a) : table(&a), terms(a), elems(a) {}
+		static Id_t get(const IdTable<Id_t>& ids, Id_t id) {
+			const Id_t* c = ids.find(id);
+			return c && *c ? *c - 1 : id;
+		}
+		static void set(IdTable<Id_t>& ids, Id_t id, Id_t canon) {
+			if (id != canon)             { ids[id] = canon + 1; }
+			else if (Id_t* c = ids.find(id)) { *c = 0; }
 		}
+		// Returns the canonical id for the current key, which is id if key is new.
+		Id_t add(IdTable<Id_t>& ids, Id_t id) {
+			SpanTable<Id_t>::Entry* e = table.insert(toSpan(key), id).first;
+			if (e->value == noId) { e->value = id; }
+			set(ids, id, e->value);
+			return e->value;
+		}
+		// Detaches the current key from id if id is its representative.
+		void remove(IdTable<Id_t>& ids, Id_t id) {
+			const SpanTable<Id_t>::Entry* e = table.find(toSpan(key));
+			if (e && e->value == id) { const_cast<SpanTable<Id_t>::Entry*>(e)->value = noId; }
+			set(ids, id, id);
+		}
+		SpanTable<Id_t>   table;
+		IdTable<Id_t>     terms;
+		IdTable<Id_t>     elems;
+		std::vector<Id_t> key;
+	};
+	enum { SLAB_SIZE = 65536 };
+	explicit Data(Allocator& a) : atoms(a), elems(a), terms(a), symbols(&a, 4), slab(SLAB_SIZE, &a), share(0), version(nextVersion()) {}
+	~Data() { delete share; }
+	// Key construction for hash-consing: a type tag followed by the data of a term or element.
+	void numberKey(int num) {
+		share->key.assign(1, Theory_t::Number);
+		share->key.push_back(static_cast<Id_t>(num));
+	}
+	void symbolKey(const StringSpan& name) {
+		share->key.assign(1, Theory_t::Symbol);
+		share->key.push_back(static_cast<Id_t>(name.size));
+		share->key.resize(2 + (name.size + sizeof(Id_t) - 1) / sizeof(Id_t), 0);
+		if (name.size) { std::memcpy(&share->key[2], Potassco::begin(name), name.size); }
+	}
+	void compoundKey(int32_t base, const IdSpan& args) {
+		share->key.assign(1, Theory_t::Compound);
+		share->key.push_back(static_cast<Id_t>(base));
+		share->key.insert(share->key.end(), Potassco::begin(args), Potassco::end(args));
 	}
+	void elementKey(const IdSpan& terms, Id_t cond) {
+		share->key.assign(1, Theory_t::Element);
+		share->key.push_back(cond);
+		share->key.insert(share->key.end(), Potassco::begin(terms), Potassco::end(terms));
+	}
+	void termKey(const TheoryTerm& t) {
+		switch (t.type()) {
+			case Theory_t::Number: numberKey(t.number()); break;
+			case Theory_t::Symbol: symbolKey(Potassco::toSpan(t.symbol())); break;
+			default:               compoundKey(t.compound(), t.terms()); break;
+		}
+	}
+	// Elements and atoms only contain 32-bit members - computing their alignment via
+	// Arena::alignOf<T>() would embed a struct with a zero-size array.
+	void* make(std::size_t nBytes) { return slab.allocate(nBytes, Arena::alignOf<Id_t>()); }
+	const char* intern(const StringSpan& name);
+	// Interned names of symbolic terms. The copied keys of the table are the names
+	// referenced by symbolic terms. They are 4-byte aligned, as required by TheoryTerm,
+	// and zero-padded to 4-bytes to disable false-positives from valgrind in
+	// subsequent calls to strlen etc.
+	SpanTable<char> symbols;
+	// Atoms, elements, and compound terms are allocated in insertion order from
+	// this arena and only released on reset(). Objects are never moved, so data of
+	// previous steps stays valid until then.
+	Arena           slab;
+	Share*          share;
+	uint32_t        version;
 };
-TheoryData::TheoryData() : data_(new Data()) {}
+const char* TheoryData::Data::intern(const StringSpan& name) {
+	return symbols.insert(name, 0).first->data;
+}
+TheoryData::TheoryData(Allocator* alloc) : data_(new Data(allocatorOrDefault(alloc))) {}
 TheoryData::~TheoryData() {
-	reset();
 	delete data_;
 }
 const TheoryTerm& TheoryData::addTerm(Id_t termId, int number) {
-	return setTerm(termId) = TheoryTerm(number);
+	TheoryTerm& t = setTerm(termId);
+	if (data_->share) {
+		data_->numberKey(number);
+		data_->share->add(data_->share->terms, termId);
+	}
+	return t = TheoryTerm(number);
 }
 const TheoryTerm& TheoryData::addTerm(Id_t termId, const StringSpan& name) {
 	TheoryTerm& t = setTerm(termId);
-	// Align to 4-bytes to disable false-positives from valgrind
-	// in subsequent calls to strlen etc.
-	char* buf = new char[((name.size + 1 + 3)/4) * 4];
-	*std::copy(Potassco::begin(name), Potassco::end(name), buf) = 0;
-	return (t = TheoryTerm(buf));
+	if (data_->share) {
+		data_->symbolKey(name);
+		Id_t c = data_->share->add(data_->share->terms, termId);
+		if (c != termId) { return t = getTerm(c); }
+	}
+	return (t = TheoryTerm(data_->intern(name)));
 }
 const TheoryTerm& TheoryData::addTerm(Id_t termId, const char* name) {
 	return addTerm(termId, Potassco::toSpan(name, name ? std::strlen(name) : 0));
 }
 const TheoryTerm& TheoryData::addTerm(Id_t termId, Id_t funcId, const IdSpan& args) {
-	return setTerm(termId) = TheoryTerm(FuncData::newFunc(static_cast<int32_t>(funcId), args));
+	return addCompound(termId, static_cast<int32_t>(funcId), args);
 }
 const TheoryTerm& TheoryData::addTerm(Id_t termId, Tuple_t type, const IdSpan& args) {
-	return setTerm(termId) = TheoryTerm(FuncData::newFunc(static_cast<int32_t>(type), args));
+	return addCompound(termId, static_cast<int32_t>(type), args);
+}
+const TheoryTerm& TheoryData::addCompound(Id_t termId, int32_t base, const IdSpan& args) {
+	TheoryTerm& t = setTerm(termId);
+	if (data_->share) {
+		data_->compoundKey(base, args);
+		Id_t c = data_->share->add(data_->share->terms, termId);
+		if (c != termId) { return t = getTerm(c); }
+	}
+	return t = TheoryTerm(FuncData::newFunc(data_->slab, base, args));
 }
 void TheoryData::removeTerm(Id_t termId) {
 	if (hasTerm(termId)) {
-		DestroyT()(terms()[termId]);
-		terms()[termId] = Term();
+		if (data_->share) {
+			data_->termKey(getTerm(termId));
+			data_->share->remove(data_->share->terms, termId);
+		}
+		data_->terms[termId] = Term();
+		data_->version = nextVersion();
 	}
 }
 const TheoryElement& TheoryData::addElement(Id_t id, const IdSpan& terms, Id_t cId) {
-	if (!hasElement(id)) {
-		for (uint32_t i = numElems(); i <= id; ++i) { data_->elems.push(); }
-	}
-	else {
+	if (hasElement(id)) {
 		POTASSCO_REQUIRE(!isNewElement(id), "Redefinition of theory element '%u'", id);
-		DestroyT()(elems()[id]);
+		const TheoryElement& old = getElement(id);
+		if (data_->share && old.condition() != COND_DEFERRED) {
+			data_->elementKey(old.terms(), old.condition());
+			data_->share->remove(data_->share->elems, id);
+		}
+	}
+	if (data_->share && cId != COND_DEFERRED) {
+		data_->elementKey(terms, cId);
+		Id_t c = data_->share->add(data_->share->elems, id);
+		if (c != id) { return *(data_->elems[id] = data_->elems[c]); }
 	}
-	return *(elems()[id] = TheoryElement::newElement(terms, cId));
+	std::size_t nb = nBytes<TheoryElement>(terms) + (cId != 0 ? sizeof(Id_t) : 0);
+	return *(data_->elems[id] = new (data_->make(nb)) TheoryElement(terms, cId));
 }
 
 const TheoryAtom& TheoryData::addAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elems) {
 	data_->atoms.push();
-	return *(atoms()[numAtoms()-1] = TheoryAtom::newAtom(atomOrZero, termId, elems));
+	void* mem = data_->make(nBytes<TheoryAtom>(elems));
+	return *(atoms()[numAtoms()-1] = new (mem) TheoryAtom(atomOrZero, termId, elems, 0, 0));
 }
 const TheoryAtom& TheoryData::addAtom(Id_t atomOrZero, Id_t termId, const IdSpan& elems, Id_t op, Id_t rhs) {
 	data_->atoms.push();
-	return *(atoms()[numAtoms()-1] = TheoryAtom::newAtom(atomOrZero, termId, elems, op, rhs));
+	void* mem = data_->make(nBytes<TheoryAtom>(elems) + (2*sizeof(Id_t)));
+	return *(atoms()[numAtoms()-1] = new (mem) TheoryAtom(atomOrZero, termId, elems, &op, &rhs));
 }
 
 TheoryTerm& TheoryData::setTerm(Id_t id) {
-	if (!hasTerm(id)) {
-		for (uint32_t i = numTerms(); i <= id; ++i) { data_->terms.push(); }
-	}
-	else {
+	if (hasTerm(id)) {
 		POTASSCO_REQUIRE(!isNewTerm(id), "Redefinition of theory term '%u'", id);
 		removeTerm(id);
 	}
-	return terms()[id];
+	return data_->terms[id];
 }
 void TheoryData::setCondition(Id_t elementId, Id_t newCond) {
 	POTASSCO_ASSERT(getElement(elementId).condition() == COND_DEFERRED);
-	elems()[elementId]->setCondition(newCond);
+	const_cast<TheoryElement&>(getElement(elementId)).setCondition(newCond);
 }
 
+void TheoryData::setSharing(bool on) {
+	if (on && !data_->share) {
+		data_->share = new Data::Share(data_->slab.allocator());
+	}
+	else if (!on && data_->share) {
+		delete data_->share;
+		data_->share = 0;
+	}
+}
+bool TheoryData::sharing() const {
+	return data_->share != 0;
+}
+Id_t TheoryData::canonicalTerm(Id_t t) const {
+	const Term& term = getTerm(t);
+	Id_t c = data_->share ? Data::Share::get(data_->share->terms, t) : t;
+	return c != t && hasTerm(c) && getTerm(c).data_ == term.data_ ? c : t;
+}
+Id_t TheoryData::canonicalElement(Id_t e) const {
+	const Element& elem = getElement(e);
+	Id_t c = data_->share ? Data::Share::get(data_->share->elems, e) : e;
+	return c != e && hasElement(c) && &getElement(c) == &elem ? c : e;
+}
 void TheoryData::reset() {
-	DestroyT destroy;
-	std::for_each(terms(), terms() + numTerms(), destroy);
-	std::for_each(elems(), elems() + numElems(), destroy);
-	std::for_each(atoms(), atoms() + numAtoms(), destroy);
+	if (data_->share) {
+		delete data_->share;
+		data_->share = new Data::Share(data_->slab.allocator());
+	}
+	data_->symbols.clear();
+	data_->slab.release();
 	data_->atoms.reset();
 	data_->elems.reset();
 	data_->terms.reset();
 	data_->frame = Data::Up();
+	data_->version = nextVersion();
 }
 void TheoryData::update() {
 	data_->frame.atom = numAtoms();
 	data_->frame.term = numTerms();
 	data_->frame.elem = numElems();
 }
-TheoryTerm* TheoryData::terms() const {
-	return data_->terms.begin();
-}
-TheoryElement** TheoryData::elems() const {
-	return data_->elems.begin();
-}
 TheoryAtom** TheoryData::atoms() const {
 	return data_->atoms.begin();
 }
@@ -310,30 +458,211 @@ TheoryData::atom_iterator TheoryData::end() const {
 	return begin() + numAtoms();
 }
 bool TheoryData::hasTerm(Id_t id) const {
-	return id < numTerms() && terms()[id].valid();
+	const Term* t = data_->terms.find(id);
+	return t && t->valid();
 }
 bool TheoryData::isNewTerm(Id_t id) const {
 	return hasTerm(id) && id >= data_->frame.term;
 }
 bool TheoryData::hasElement(Id_t id) const {
-	return id < numElems() && elems()[id] != 0;
+	TheoryElement* const* e = data_->elems.find(id);
+	return e && *e;
 }
 bool TheoryData::isNewElement(Id_t id) const {
 	return hasElement(id) && id >= data_->frame.elem;
 }
 const TheoryTerm& TheoryData::getTerm(Id_t id) const {
 	POTASSCO_REQUIRE(hasTerm(id), "Unknown term '%u'", unsigned(id));
-	return terms()[id];
+	return *data_->terms.find(id);
 }
 const TheoryElement& TheoryData::getElement(Id_t id) const {
 	POTASSCO_REQUIRE(hasElement(id), "Unknown element '%u'", unsigned(id));
-	return *elems()[id];
+	return **data_->elems.find(id);
+}
+const char* TheoryData::findSymbol(const char* name) const {
+	const SpanTable<char>::Entry* e = data_->symbols.find(Potassco::toSpan(name ? name : ""));
+	return e ? e->data : 0;
+}
+uint32_t TheoryData::termVersion() const {
+	return data_->version;
 }
 void TheoryData::accept(Visitor& out, VisitMode m) const {
 	for (atom_iterator aIt = m == visit_current ? currBegin() : begin(), aEnd = end(); aIt != aEnd; ++aIt) {
 		out.visit(*this, **aIt);
 	}
 }
+/////////////////////////////////////////////////////////////////////////////////////////
+// TheoryData snapshots
+//
+// A snapshot is a sequence of 32-bit words consisting of a header
+//   MAGIC VERSION frame.term frame.elem frame.atom #terms #elements #atoms
+// followed by the records of terms, elements, and atoms:
+//   term:    id Number value | id Symbol len chars... | id Compound base n args...
+//   element: id cond n terms...
+//   atom:    atom term n hasGuard elements... [op rhs]
+// where chars of a symbol are padded to a multiple of 4 bytes.
+/////////////////////////////////////////////////////////////////////////////////////////
+namespace {
+enum { SNAPSHOT_MAGIC = 0x53445450u, SNAPSHOT_VERSION = 1u };
+struct SnapshotWriter {
+	void     push(uint32_t x) { words.push_back(x); }
+	void     push(const IdSpan& ids) {
+		push(static_cast<uint32_t>(ids.size));
+		words.insert(words.end(), Potassco::begin(ids), Potassco::end(ids));
+	}
+	void     push(const char* str) {
+		std::size_t len = std::strlen(str), pos = words.size();
+		push(static_cast<uint32_t>(len));
+		words.resize(pos + 1 + (len + 3) / 4, 0);
+		if (len) { std::memcpy(&words[pos + 1], str, len); }
+	}
+	std::vector<uint32_t> words;
+};
+struct SnapshotReader {
+	SnapshotReader(const void* p, std::size_t n) : pos(static_cast<const char*>(p)), end(pos + (n - (n % 4))) {}
+	uint32_t get() {
+		check(1);
+		uint32_t x;
+		std::memcpy(&x, pos, sizeof(x));
+		pos += sizeof(x);
+		return x;
+	}
+	// Returns the next n ids, which are copied to buf if the snapshot is not suitably aligned.
+	IdSpan ids(std::vector<Id_t>& buf) {
+		uint32_t n = get();
+		check(n);
+		const char* ids = pos;
+		pos += n * sizeof(Id_t);
+		if ((reinterpret_cast<uintptr_t>(ids) % sizeof(Id_t)) == 0) {
+			return Potassco::toSpan(reinterpret_cast<const Id_t*>(ids), n);
+		}
+		buf.resize(n);
+		if (n) { std::memcpy(&buf[0], ids, n * sizeof(Id_t)); }
+		return Potassco::toSpan(buf);
+	}
+	StringSpan str() {
+		std::size_t len = get(), words = (len + 3) / 4;
+		check(words);
+		StringSpan s = Potassco::toSpan(pos, len);
+		pos += words * 4;
+		return s;
+	}
+	void check(std::size_t words) const {
+		POTASSCO_EXPECT(static_cast<std::size_t>(end - pos) / 4 >= words, "Invalid theory snapshot: unexpected end of data");
+	}
+	const char* pos;
+	const char* end;
+};
+}
+void TheoryData::save(std::ostream& out) const {
+	SnapshotWriter w;
+	w.push(SNAPSHOT_MAGIC);
+	w.push(SNAPSHOT_VERSION);
+	w.push(data_->frame.term);
+	w.push(data_->frame.elem);
+	w.push(data_->frame.atom);
+	std::size_t counts = w.words.size();
+	w.words.resize(counts + 3, 0);
+	for (Id_t id = 0, end = numTerms(); id != end; ++id) {
+		const Term* t = data_->terms.find(id);
+		if (!t) { id = std::min(id | Data::IdTable<Term>::PAGE_MASK, end - 1); continue; }
+		if (!t->valid()) { continue; }
+		w.push(id);
+		w.push(t->type());
+		switch (t->type()) {
+			case Theory_t::Number: w.push(static_cast<uint32_t>(t->number())); break;
+			case Theory_t::Symbol: w.push(t->symbol()); break;
+			default:               w.push(static_cast<uint32_t>(t->compound())); w.push(t->terms()); break;
+		}
+		++w.words[counts];
+	}
+	for (Id_t id = 0, end = numElems(); id != end; ++id) {
+		TheoryElement* const* e = data_->elems.find(id);
+		if (!e) { id = std::min(id | Data::IdTable<TheoryElement*>::PAGE_MASK, end - 1); continue; }
+		if (!*e) { continue; }
+		w.push(id);
+		w.push((*e)->condition());
+		w.push((*e)->terms());
+		++w.words[counts + 1];
+	}
+	for (atom_iterator it = begin(), end = this->end(); it != end; ++it) {
+		const TheoryAtom& a = **it;
+		w.push(a.atom());
+		w.push(a.term());
+		w.push(a.elements());
+		w.push(a.guard() != 0);
+		if (a.guard()) {
+			w.push(*a.guard());
+			w.push(*a.rhs());
+		}
+	}
+	w.words[counts + 2] = numAtoms();
+	out.write(reinterpret_cast<const char*>(&w.words[0]), static_cast<std::streamsize>(w.words.size() * sizeof(uint32_t)));
+}
+void TheoryData::load(const void* snapshot, std::size_t bytes) {
+	SnapshotReader r(snapshot, bytes);
+	POTASSCO_EXPECT(r.get() == SNAPSHOT_MAGIC, "Invalid theory snapshot: bad magic");
+	POTASSCO_EXPECT(r.get() == SNAPSHOT_VERSION, "Invalid theory snapshot: unsupported version");
+	reset();
+	Data::Up frame;
+	frame.term = r.get();
+	frame.elem = r.get();
+	frame.atom = r.get();
+	uint32_t nTerms = r.get(), nElems = r.get(), nAtoms = r.get();
+	std::vector<Id_t> buf;
+	for (uint32_t i = 0; i != nTerms; ++i) {
+		Id_t id = r.get();
+		POTASSCO_EXPECT(!hasTerm(id), "Invalid theory snapshot: duplicate term '%u'", id);
+		switch (uint32_t type = r.get()) {
+			case Theory_t::Number: addTerm(id, static_cast<int>(r.get())); break;
+			case Theory_t::Symbol: addTerm(id, r.str()); break;
+			case Theory_t::Compound: {
+				int32_t base = static_cast<int32_t>(r.get());
+				addCompound(id, base, r.ids(buf));
+				break;
+			}
+			default: POTASSCO_EXPECT(false, "Invalid theory snapshot: bad term type '%u'", type);
+		}
+	}
+	for (uint32_t i = 0; i != nElems; ++i) {
+		Id_t id = r.get();
+		POTASSCO_EXPECT(!hasElement(id), "Invalid theory snapshot: duplicate element '%u'", id);
+		Id_t cond = r.get();
+		addElement(id, r.ids(buf), cond);
+	}
+	for (uint32_t i = 0; i != nAtoms; ++i) {
+		Id_t atom = r.get(), term = r.get();
+		IdSpan elems = r.ids(buf);
+		if (r.get() == 0) { addAtom(atom, term, elems); }
+		else {
+			Id_t op = r.get();
+			addAtom(atom, term, elems, op, r.get());
+		}
+	}
+	POTASSCO_EXPECT(frame.term <= numTerms() && frame.elem <= numElems() && frame.atom <= numAtoms(), "Invalid theory snapshot: bad step boundary");
+	data_->frame = frame;
+}
+namespace {
+// Visits a consecutive range of theory atoms with the visitor of one worker.
+struct AcceptRange {
+	void operator()(unsigned i) const {
+		std::size_t n = workers.size, b = (size * i) / n, e = (size * (i + 1)) / n;
+		for (TheoryData::Visitor& out = *workers[i]; b != e; ++b) { out.visit(*data, *first[b]); }
+	}
+	const TheoryData*         data;
+	TheoryData::atom_iterator first;
+	std::size_t               size;
+	Span<TheoryData::Visitor*> workers;
+};
+}
+void TheoryData::accept(const Span<Visitor*>& workers, VisitMode m) const {
+	atom_iterator first = m == visit_current ? currBegin() : begin();
+	AcceptRange range = {this, first, static_cast<std::size_t>(end() - first), workers};
+	unsigned n = static_cast<unsigned>(std::min(workers.size, range.size));
+	if (n == 0) { return; }
+	range.workers.size = n;
+	detail::parallelFor(n, range);
+}
 void TheoryData::accept(const TheoryTerm& t, Visitor& out, VisitMode m) const {
 	if (t.type() == Theory_t::Compound) {
 		for (TheoryTerm::iterator it = t.begin(), end = t.end(); it != end; ++it) {
@@ -28,10 +28,16 @@
 #include "test_common.h"
 #include <potassco/aspif.h>
 #include <potassco/rule_utils.h>
+#include <potassco/span_table.h>
+#include <potassco/arena.h>
+#include <potassco/paged_map.h>
 #include <potassco/theory_data.h>
 #include <potassco/aspif_text.h>
+#include <potassco/program_transform.h>
+#include <potassco/clingo.h>
 #include <sstream>
 #include <cstring>
+#include <cstdio>
 namespace Potassco {
 namespace Test {
 namespace Aspif {
@@ -108,6 +114,10 @@ public:
 	TheoryData  theory;
 };
 
+template <class T>
+static Vec<T> toVec(const Span<T>& s) {
+	return Vec<T>(begin(s), end(s));
+}
 static int compareRead(std::stringstream& input, ReadObserver& observer, const Rule* rules, const std::pair<unsigned, unsigned>& subset) {
 	for (unsigned i = 0; i != subset.second; ++i) { rule(input, rules[subset.first + i]); }
 	finalize(input);
@@ -186,7 +196,376 @@ TEST_CASE("Test RuleBuilder", "[rule]") {
 		REQUIRE(*Potassco::begin(rb.body()) == 5);
 		REQUIRE(rb.bodyType() == Body_t::Normal);
 	}
+	SECTION("large sum with reserve") {
+		const Weight_t n = 200000;
+		rb.start().addHead(1).startSum(n).reserve(0, n);
+		for (Weight_t i = 1; i <= n; ++i) { rb.addGoal(i % 2 ? i : -i, i); }
+		rb.end();
+		REQUIRE(Potassco::size(rb.sum().lits) == static_cast<std::size_t>(n));
+		REQUIRE(rb.bound() == n);
+		REQUIRE(rb.wlits_end()[-1].weight == n);
+		REQUIRE(*Potassco::begin(rb.head()) == 1);
+	}
+}
+TEST_CASE("Test MemoryRegion", "[rule]") {
+	MemoryRegion m(16);
+	REQUIRE(m.size() == 16);
+	m.grow(100);
+	REQUIRE(m.size() >= 100);
+	std::size_t s = m.size();
+	m.grow(s + 1);
+	REQUIRE(m.size() >= (s * 3) / 2);
+	m.release();
+	REQUIRE(m.size() == 0);
+}
+TEST_CASE("Test rule normalization", "[rule]") {
+	RuleBuilder rb;
+	SECTION("normal body") {
+		rb.start().addHead(3).addHead(1).addHead(3).startBody().addGoal(4).addGoal(-2).addGoal(4).addGoal(5);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyOpen);
+		REQUIRE(toVec(rb.head()) == (Vec<Atom_t>{1, 3}));
+		REQUIRE(toVec(rb.body()) == (Vec<Lit_t>{-2, 4, 5}));
+		rb.clear().start().addHead(1).startBody().addGoal(-2).addGoal(3).addGoal(2);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyFalse);
+		REQUIRE(toVec(rb.body()) == (Vec<Lit_t>{2, -2, 3}));
+		REQUIRE(hasComplement(rb.lits_begin(), rb.lits_end()));
+		rb.clear().start().addHead(1);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyTrue);
+	}
+	SECTION("sum body") {
+		rb.start().addHead(1).startSum(3).addGoal(2, 1).addGoal(3, 2).addGoal(2, 1).addGoal(-3, 1).addGoal(4, -2);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyOpen);
+		// 2:2, 3:1, ~4:2 with bound 3 + 2 - 1
+		REQUIRE(rb.bound() == 4);
+		REQUIRE(toVec(rb.sum().lits) == (Vec<WeightLit_t>{{2, 2}, {3, 1}, {-4, 2}}));
+		rb.clear().start().addHead(1).startSum(2).addGoal(2, 2).addGoal(-2, 2);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyTrue);
+		rb.clear().start().addHead(1).startSum(4).addGoal(2, 2).addGoal(3, 1);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyFalse);
+	}
+	SECTION("count body becomes sum") {
+		rb.start().addHead(1).startSum(2).addGoal(2).addGoal(2).addGoal(3).weaken(Body_t::Count);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyOpen);
+		REQUIRE(rb.bodyType() == Body_t::Sum);
+		REQUIRE(toVec(rb.sum().lits) == (Vec<WeightLit_t>{{2, 2}, {3, 1}}));
+	}
+	SECTION("minimize") {
+		rb.startMinimize(1).addGoal(-2, -1).addGoal(1, 2).addGoal(-2, 3).addGoal(1, -2);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyOpen);
+		REQUIRE(toVec(rb.sum().lits) == (Vec<WeightLit_t>{{-2, 2}}));
+		REQUIRE(rb.bound() == 1);
+	}
+	SECTION("extreme weights") {
+		rb.startMinimize(1).addGoal(2, INT_MAX).addGoal(2, INT_MAX).addGoal(3, INT_MIN).addGoal(3, INT_MIN).addGoal(4, INT_MAX).addGoal(4, 1);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyOpen);
+		REQUIRE(toVec(rb.sum().lits) == (Vec<WeightLit_t>{{2, INT_MAX}, {2, INT_MAX}, {3, INT_MIN}, {3, INT_MIN}, {4, INT_MAX}, {4, 1}}));
+		rb.clear().start().addHead(1).startSum(5).addGoal(2, INT_MAX).addGoal(2, INT_MAX).addGoal(3, 1);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyOpen);
+		REQUIRE(rb.bound() == 5);
+		REQUIRE(toVec(rb.sum().lits) == (Vec<WeightLit_t>{{2, 5}, {3, 1}}));
+		rb.clear().start().addHead(1).startSum(5).addGoal(2, INT_MAX).addGoal(2, INT_MAX).addGoal(-2, INT_MAX);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyTrue);
+		rb.clear().start().addHead(1).startSum(INT_MIN).addGoal(3, INT_MIN);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyTrue);
+		rb.clear().start().addHead(1).startSum(INT_MAX).addGoal(2, INT_MIN);
+		REQUIRE(rb.normalize() == RuleBuilder::BodyFalse);
+		rb.clear().start().addHead(1).startSum(INT_MAX).addGoal(2, INT_MIN).addGoal(3, INT_MAX).addGoal(3, INT_MAX);
+		REQUIRE_THROWS_AS(rb.normalize(), std::overflow_error);
+	}
+	SECTION("long bodies") {
+		Vec<Lit_t> exp;
+		rb.start().addHead(1).startBody();
+		for (Lit_t i = 5000; i > 0; --i) {
+			rb.addGoal(i % 3 ? i : -i);
+			rb.addGoal(i % 3 ? i : -i);
+			exp.push_back(i % 3 ? i : -i);
+		}
+		std::sort(exp.begin(), exp.end(), [](Lit_t a, Lit_t b) { return atom(a) < atom(b); });
+		REQUIRE(rb.normalize() == RuleBuilder::BodyOpen);
+		REQUIRE(toVec(rb.body()) == exp);
+		REQUIRE(toVec(rb.head()) == Vec<Atom_t>{1});
+	}
+}
+TEST_CASE("Test RuleBatch", "[rule]") {
+	RuleBatch batch;
+	RuleBuilder rb;
+	REQUIRE(batch.empty());
+	batch.add(Head_t::Choice, toSpan(Vec<Atom_t>{1, 2}), toSpan(Vec<Lit_t>{-3}));
+	batch.add(rb.start().addHead(3).startSum(2).addGoal(1, 2).addGoal(-2, 1).end());
+	batch.add(rb.startMinimize(5).addGoal(-1, 3).end());
+	batch.add(Head_t::Disjunctive, Potassco::toSpan<Atom_t>(), Potassco::toSpan<Lit_t>());
+	REQUIRE(batch.size() == 4);
+	Rule_t r = batch.rule(1);
+	REQUIRE(r.sum());
+	REQUIRE(toVec(r.head) == Vec<Atom_t>{3});
+	REQUIRE(r.agg.bound == 2);
+	REQUIRE(toVec(r.agg.lits) == (Vec<WeightLit_t>{{1, 2}, {-2, 1}}));
+	REQUIRE_FALSE(batch.isMinimize(1));
+	REQUIRE(batch.isMinimize(2));
+	REQUIRE(batch.rule(2).agg.bound == 5);
+
+	SECTION("emit") {
+		ReadObserver observer;
+		batch.emit(observer);
+		REQUIRE(observer.rules == (Vec<Rule>{
+			{Head_t::Choice, {1, 2}, Body_t::Normal, BOUND_NONE, {{-3, 1}}},
+			{Head_t::Disjunctive, {3}, Body_t::Sum, 2, {{1, 2}, {-2, 1}}},
+			{Head_t::Disjunctive, {}, Body_t::Normal, BOUND_NONE, {}},
+		}));
+		REQUIRE(observer.min.size() == 1);
+		REQUIRE(observer.min[0].first == 5);
+	}
+	SECTION("emit to aspif") {
+		std::stringstream exp, str;
+		AspifOutput single(exp), batched(str);
+		single.AbstractProgram::rules(batch);
+		batch.emit(batched);
+		REQUIRE(exp.str().size() > 0);
+		REQUIRE(str.str() == exp.str());
+	}
+	SECTION("many rules") {
+		batch.clear();
+		REQUIRE(batch.empty());
+		for (Atom_t a = 1; a != 10001; ++a) {
+			batch.add(Head_t::Disjunctive, toSpan(&a, 1), toSpan(Vec<Lit_t>{-static_cast<Lit_t>(a + 1)}));
+		}
+		REQUIRE(batch.size() == 10000);
+		for (uint32_t i = 0; i != batch.size(); ++i) {
+			r = batch.rule(i);
+			REQUIRE((r.head.size == 1 && *r.head.first == i + 1 && r.cond.size == 1 && *r.cond.first == -static_cast<Lit_t>(i + 2)));
+		}
+	}
+}
+struct CountingAllocator : Allocator {
+	CountingAllocator() : live(0), calls(0) {}
+	virtual void* allocate(std::size_t n) { live += n; ++calls; return mallocAllocator().allocate(n); }
+	virtual void  deallocate(void* p, std::size_t n) { live -= n; mallocAllocator().deallocate(p, n); }
+	std::size_t live;
+	std::size_t calls;
+};
+TEST_CASE("Test Allocator", "[rule]") {
+	CountingAllocator alloc;
+	SECTION("memory region and rule builder") {
+		{
+			RuleBuilder rb(&alloc);
+			for (Lit_t i = 1; i != 1000; ++i) { rb.addGoal(i); }
+			RuleBuilder copy(rb);
+			REQUIRE(toVec(copy.body()) == toVec(rb.body()));
+			REQUIRE(alloc.live > 0);
+		}
+		REQUIRE(alloc.live == 0);
+	}
+	SECTION("span table") {
+		{
+			SpanTable<char> tab(&alloc);
+			char buf[16];
+			for (Id_t i = 0; i != 100; ++i) {
+				std::sprintf(buf, "a(%u)", i);
+				tab.insert(toSpan(buf), i);
+			}
+			REQUIRE(alloc.live > 0);
+		}
+		REQUIRE(alloc.live == 0);
+	}
+	SECTION("theory data") {
+		{
+			TheoryData data(&alloc);
+			Vec<Id_t> args = {0, 1};
+			data.addTerm(0, 1);
+			data.addTerm(1, "foo");
+			data.addTerm(2, 1, toSpan(args));
+			data.addElement(0, toSpan(args), 7);
+			data.addElement(1, toSpan(args), 0);
+			data.addAtom(1, 1, toSpan(args));
+			data.addAtom(2, 1, toSpan(args), 0, 2);
+			data.update();
+			data.addTerm(1, "bar");
+			data.removeTerm(2);
+			REQUIRE(alloc.live > 0);
+		}
+		REQUIRE(alloc.live == 0);
+	}
+	SECTION("theory elements and atoms") {
+		Vec<Id_t> args = {1, 2, 3};
+		TheoryElement* e1 = TheoryElement::newElement(toSpan(args), 0, &alloc);
+		TheoryElement* e2 = TheoryElement::newElement(toSpan(args), 7, &alloc);
+		TheoryAtom* a1 = TheoryAtom::newAtom(1, 2, toSpan(args), &alloc);
+		TheoryAtom* a2 = TheoryAtom::newAtom(1, 2, toSpan(args), 4, 5, &alloc);
+		REQUIRE(alloc.calls == 4);
+		REQUIRE(e2->condition() == 7);
+		REQUIRE(*a2->rhs() == 5);
+		TheoryElement::destroy(e1, &alloc);
+		TheoryElement::destroy(e2, &alloc);
+		TheoryAtom::destroy(a1, &alloc);
+		TheoryAtom::destroy(a2, &alloc);
+		REQUIRE(alloc.live == 0);
+	}
+	SECTION("theory data sparse ids") {
+		TheoryData data(&alloc);
+		Vec<Id_t> args = {7, 1u << 30};
+		data.addTerm(7, "foo");
+		data.addTerm(1u << 30, 12);
+		data.addTerm((1u << 30) + 1, Tuple_t::Paren, toSpan(args));
+		data.addElement(1u << 29, toSpan(args), 0);
+		REQUIRE(alloc.live < (1u << 25)); // dense storage would need 8GB
+		REQUIRE(data.hasTerm(1u << 30));
+		REQUIRE_FALSE(data.hasTerm((1u << 30) - 1));
+		REQUIRE_FALSE(data.hasTerm(8));
+		REQUIRE(data.getTerm(1u << 30).number() == 12);
+		REQUIRE(data.hasElement(1u << 29));
+		REQUIRE_FALSE(data.hasElement(0));
+		data.update();
+		REQUIRE_FALSE(data.isNewTerm(1u << 30));
+		for (Id_t i = 0; i != 5000; ++i) { data.addTerm(i + 8, static_cast<int>(i)); }
+		REQUIRE(data.getTerm(7).symbol() == std::string("foo"));
+		REQUIRE(data.getTerm(5007).number() == 4999);
+		REQUIRE(data.getTerm((1u << 30) + 1).size() == 2);
+		data.addTerm((1u << 30) + 2, 1);
+		REQUIRE(data.isNewTerm((1u << 30) + 2));
+		REQUIRE_THROWS_AS(data.addTerm(UINT32_MAX, 1), std::logic_error);
+		REQUIRE(data.getTerm((1u << 30) + 2).number() == 1);
+	}
+	SECTION("theory data slab") {
+		TheoryData data(&alloc);
+		Vec<Id_t> args = {0};
+		data.addTerm(0, "foo");
+		for (Id_t i = 1; i != 1000; ++i) {
+			data.addTerm(i, 0, toSpan(args));
+			data.addElement(i, toSpan(args), i);
+			data.addAtom(i, 0, toSpan(&i, 1));
+		}
+		const TheoryAtom* first = *data.begin();
+		std::size_t calls = alloc.calls, live = alloc.live;
+		REQUIRE(calls < 100);
+		data.update();
+		data.addAtom(1000, 0, toSpan(args));
+		REQUIRE(*data.begin() == first);
+		REQUIRE(first->atom() == 1);
+		REQUIRE(data.getElement(1).condition() == 1);
+		data.reset();
+		REQUIRE(alloc.live < live);
+		REQUIRE(data.numAtoms() == 0);
+	}
+	SECTION("arena allocator") {
+		ArenaAllocator arena(4096, &alloc);
+		void* p = arena.allocate(100);
+		REQUIRE(arena.reallocate(p, 100, 200) == p);
+		std::memset(p, 1, 200);
+		{
+			TheoryData data(&arena);
+			data.addTerm(0, "foo");
+			RuleBuilder rb(&arena);
+			for (Lit_t i = 1; i != 10000; ++i) { rb.addGoal(i); }
+			REQUIRE(Potassco::size(rb.body()) == 9999u);
+		}
+		REQUIRE(alloc.live == arena.capacity());
+		arena.release();
+		REQUIRE(alloc.live == 0);
+	}
+	SECTION("huge page allocator") {
+		HugePageAllocator huge(4096);
+		RuleBuilder rb(&huge);
+		for (Lit_t i = 1; i != 100000; ++i) { rb.addGoal(i); }
+		REQUIRE(Potassco::size(rb.body()) == 99999u);
+		REQUIRE(*(rb.lits_end() - 1) == 99999);
+		void* p = huge.allocate(10);
+		huge.deallocate(p, 10);
+	}
+}
+TEST_CASE("Test SpanTable", "[rule]") {
+	SpanTable<char> tab;
+	REQUIRE(tab.empty());
+	REQUIRE(tab.find(toSpan("foo")) == 0);
+	SECTION("insert keeps first value") {
+		SpanTable<char>::InsertResult r = tab.insert(toSpan("foo"), 1);
+		REQUIRE(r.second);
+		REQUIRE(std::strcmp(r.first->data, "foo") == 0);
+		REQUIRE_FALSE(tab.insert(toSpan("foo"), 2).second);
+		REQUIRE(tab.find(toSpan("foo"))->value == 1);
+		REQUIRE(tab.find(toSpan("fo")) == 0);
+		REQUIRE(tab.insert(toSpan(""), 3).second);
+		REQUIRE(tab.find(toSpan(""))->value == 3);
+		REQUIRE(tab.size() == 2);
+	}
+	SECTION("keys are stable") {
+		const char* foo = tab.insert(toSpan("foo"), 0).first->data;
+		char buf[16];
+		for (Id_t i = 0; i != 1000; ++i) {
+			std::sprintf(buf, "a(%u)", i);
+			REQUIRE(tab.insert(toSpan(buf), i).second);
+		}
+		REQUIRE(tab.size() == 1001);
+		REQUIRE(tab.find(toSpan("foo"))->data == foo);
+		for (Id_t i = 0; i != 1000; ++i) {
+			std::sprintf(buf, "a(%u)", i);
+			REQUIRE(tab.find(toSpan(buf), SpanTable<char>::hash(toSpan(buf)))->value == i);
+		}
+		tab.clear();
+		REQUIRE(tab.empty());
+		REQUIRE(tab.find(toSpan("foo")) == 0);
+	}
+	SECTION("non-char keys") {
+		SpanTable<Lit_t> lits;
+		Lit_t c1[] = {1, -2, 3}, c2[] = {1, -2};
+		REQUIRE(lits.insert(toSpan(c1, 3), 7).second);
+		REQUIRE(lits.insert(toSpan(c2, 2), 8).second);
+		REQUIRE(lits.find(toSpan(c1, 3))->value == 7);
+		REQUIRE(lits.find(toSpan(c1, 2))->value == 8);
+		REQUIRE(lits.find(toSpan(c1, 1)) == 0);
+	}
+	SECTION("aligned keys") {
+		SpanTable<char> syms(0, 8);
+		for (const char* k : {"a", "abcdefgh", "xy"}) {
+			const char* d = syms.insert(toSpan(k), 0).first->data;
+			REQUIRE(reinterpret_cast<uintptr_t>(d) % 8 == 0);
+			REQUIRE(std::strcmp(d, k) == 0);
+		}
+	}
 }
+
+TEST_CASE("Test PagedMap", "[rule]") {
+	typedef PagedMap<Id_t, 4> MapType;
+	MapType map(idMax);
+	REQUIRE(map.get(0) == idMax);
+	REQUIRE(map.get(atomMax) == idMax);
+	SECTION("sparse ids") {
+		map[atomMax] = 1;
+		map[atomMax - 100] = 2;
+		REQUIRE(map.get(atomMax) == 1);
+		REQUIRE(map.get(atomMax - 100) == 2);
+		REQUIRE(map.get(atomMax - 1) == idMax);
+		REQUIRE(map.get(3) == idMax);
+	}
+	SECTION("dense prefix takes over pages") {
+		map[40] = 40;
+		map[3] = 3;
+		REQUIRE(map.get(40) == 40);
+		for (Id_t i = 0; i != 64; ++i) { map[i] = i; }
+		for (Id_t i = 0; i != 64; ++i) { REQUIRE(map.get(i) == i); }
+		REQUIRE(map.get(64) == idMax);
+	}
+	SECTION("clear") {
+		map[7] = 1;
+		map[1000] = 2;
+		map.clear();
+		REQUIRE(map.get(7) == idMax);
+		REQUIRE(map.get(1000) == idMax);
+	}
+	SECTION("allocator") {
+		CountingAllocator alloc;
+		{
+			MapType m(0, &alloc);
+			for (Id_t i = 0; i != 100; ++i) { m[i] = i; }
+			m[atomMax] = 1;
+			REQUIRE(m.find(atomMax - 1) != nullptr);
+			REQUIRE(m.find(atomMax - 100) == nullptr);
+			for (Id_t i = 0; i != 100; ++i) { REQUIRE(m.get(i) == i); }
+			REQUIRE(alloc.live > 0);
+		}
+		REQUIRE(alloc.live == 0);
+	}
+}
+
 TEST_CASE("Intermediate Format Reader ", "[aspif]") {
 	std::stringstream input;
 	ReadObserver observer;
@@ -599,5 +978,374 @@ TEST_CASE("TheoryData", "[aspif]") {
 		}
 	}
 }
+TEST_CASE("TheoryData parallel accept", "[aspif]") {
+	struct AtomCounter : TheoryData::Visitor {
+		AtomCounter() : atoms(0), terms(0) {}
+		void visit(const TheoryData&, Id_t, const TheoryTerm&) override { ++terms; }
+		void visit(const TheoryData& data, Id_t, const TheoryElement& e) override { data.accept(e, *this); }
+		void visit(const TheoryData& data, const TheoryAtom& a) override {
+			++atoms;
+			sum += a.atom();
+			data.accept(a, *this);
+		}
+		uint32_t atoms, terms;
+		uint64_t sum = 0;
+	};
+	TheoryData data;
+	Vec<Id_t> args = {0};
+	data.addTerm(0, "x");
+	data.addElement(0, toSpan(args), 0);
+	for (Id_t a = 1; a <= 1000; ++a) { data.addAtom(a, 0, toSpan(args)); }
+	AtomCounter counters[4];
+	Vec<TheoryData::Visitor*> workers = {&counters[0], &counters[1], &counters[2], &counters[3]};
+	data.accept(toSpan(workers), TheoryData::visit_all);
+	uint32_t atoms = 0, terms = 0;
+	uint64_t sum = 0;
+	for (const AtomCounter& c : counters) {
+		REQUIRE(c.atoms == 250);
+		atoms += c.atoms;
+		terms += c.terms;
+		sum   += c.sum;
+	}
+	REQUIRE(atoms == 1000);
+	REQUIRE(terms == 2000);
+	REQUIRE(sum == 500500);
+	REQUIRE(counters[3].sum == (751 + 1000) * 125);
+	data.update();
+	data.addAtom(1001, 0, toSpan(args));
+	data.accept(toSpan(workers));
+	REQUIRE(counters[0].atoms == 251);
+	REQUIRE(counters[1].atoms == 250);
+}
+TEST_CASE("TheoryData snapshot", "[aspif]") {
+	TheoryData data;
+	Vec<Id_t> args = {0, 1};
+	data.addTerm(0, "foo");
+	data.addTerm(1, -7);
+	data.addTerm(2, 0, toSpan(args));
+	data.addElement(0, toSpan(args), 3);
+	data.addElement(1, toSpan(args));
+	data.addAtom(1, 2, toSpan(Vec<Id_t>{0, 1}));
+	data.update();
+	data.addTerm(1u << 20, Tuple_t::Brace, toSpan(args));
+	data.addElement(2, toSpan(args), 0);
+	data.addAtom(0, 0, toSpan(Vec<Id_t>{2}), 0, 1u << 20);
+	std::stringstream str;
+	data.save(str);
+	std::string blob = str.str();
+	TheoryData copy;
+	copy.addTerm(3, 1);
+	copy.load(blob.data(), blob.size());
+	REQUIRE_FALSE(copy.hasTerm(3));
+	REQUIRE(copy.getTerm(0).symbol() == std::string("foo"));
+	REQUIRE(copy.getTerm(1).number() == -7);
+	REQUIRE(copy.getTerm(2).function() == 0);
+	REQUIRE(toVec(copy.getTerm(2).terms()) == args);
+	REQUIRE(copy.getTerm(1u << 20).tuple() == Tuple_t::Brace);
+	REQUIRE(copy.getElement(0).condition() == 3);
+	REQUIRE(copy.getElement(1).condition() == static_cast<Id_t>(TheoryData::COND_DEFERRED));
+	REQUIRE(copy.getElement(2).condition() == 0);
+	REQUIRE(copy.numAtoms() == 2);
+	REQUIRE(copy.currBegin() - copy.begin() == 1);
+	REQUIRE_FALSE(copy.isNewTerm(2));
+	REQUIRE(copy.isNewTerm(1u << 20));
+	REQUIRE(copy.isNewElement(2));
+	const TheoryAtom& a = **copy.currBegin();
+	REQUIRE((a.guard() && *a.guard() == 0 && *a.rhs() == (1u << 20)));
+	std::stringstream again;
+	copy.save(again);
+	REQUIRE(again.str() == blob);
+	SECTION("unaligned") {
+		std::string buf = " " + blob;
+		copy.load(buf.data() + 1, blob.size());
+		REQUIRE(toVec(copy.getTerm(2).terms()) == args);
+	}
+	SECTION("invalid") {
+		REQUIRE_THROWS_AS(copy.load(blob.data(), blob.size() - 4), std::runtime_error);
+		std::string bad = blob;
+		bad[0] = 'x';
+		REQUIRE_THROWS_AS(copy.load(bad.data(), bad.size()), std::runtime_error);
+	}
+	SECTION("oversized symbol length") {
+		uint32_t head[2];
+		std::memcpy(head, blob.data(), sizeof(head));
+		Vec<uint32_t> bad = {head[0], head[1], 0, 0, 0, 1, 0, 0, 0, Theory_t::Symbol, 0xFFFFFFFEu};
+		REQUIRE_THROWS_AS(copy.load(bad.data(), bad.size() * sizeof(uint32_t)), std::runtime_error);
+	}
+}
+TEST_CASE("TheoryData symbols", "[aspif]") {
+	TheoryData data;
+	data.addTerm(0, "sum");
+	data.addTerm(1, "+");
+	data.addTerm(2, toSpan("sum"));
+	REQUIRE(data.getTerm(0).symbol() == data.getTerm(2).symbol());
+	REQUIRE(data.getTerm(0).symbol() != data.getTerm(1).symbol());
+	REQUIRE(data.findSymbol("+") == data.getTerm(1).symbol());
+	REQUIRE(data.findSymbol("-") == nullptr);
+	data.update();
+	data.removeTerm(0);
+	data.addTerm(3, "sum");
+	REQUIRE(data.getTerm(3).symbol() == data.getTerm(2).symbol());
+	REQUIRE(std::strcmp(data.getTerm(3).symbol(), "sum") == 0);
+	REQUIRE(reinterpret_cast<uintptr_t>(data.findSymbol("+")) % 4 == 0);
+	data.reset();
+	REQUIRE(data.findSymbol("sum") == nullptr);
+	data.addTerm(0, "sum");
+	REQUIRE(data.findSymbol("sum") == data.getTerm(0).symbol());
+}
+TEST_CASE("TheoryData sharing", "[aspif]") {
+	TheoryData data;
+	data.setSharing(true);
+	REQUIRE(data.sharing());
+	Vec<Id_t> args = {0, 1};
+	data.addTerm(0, "x");
+	data.addTerm(1, 1);
+	data.addTerm(2, "x");
+	data.addTerm(3, 1);
+	data.addTerm(4, 0, toSpan(args));
+	data.addTerm(5, 0, toSpan(args));
+	data.addTerm(6, Tuple_t::Paren, toSpan(args));
+	REQUIRE(data.canonicalTerm(2) == 0);
+	REQUIRE(data.canonicalTerm(3) == 1);
+	REQUIRE(data.canonicalTerm(5) == 4);
+	REQUIRE(data.canonicalTerm(6) == 6);
+	REQUIRE(data.getTerm(2).symbol() == data.getTerm(0).symbol());
+	REQUIRE(data.getTerm(5).begin() == data.getTerm(4).begin());
+	data.addElement(0, toSpan(args), 1);
+	data.addElement(1, toSpan(args), 1);
+	data.addElement(2, toSpan(args), 2);
+	data.addElement(3, toSpan(args));
+	data.addElement(4, toSpan(args));
+	REQUIRE(data.canonicalElement(1) == 0);
+	REQUIRE(data.canonicalElement(2) == 2);
+	REQUIRE(data.canonicalElement(4) == 4);
+	SECTION("removed representative") {
+		data.update();
+		data.removeTerm(4);
+		REQUIRE(data.canonicalTerm(5) == 5);
+		data.addTerm(7, 0, toSpan(args));
+		REQUIRE(data.canonicalTerm(7) == 7);
+		data.addTerm(4, 1);
+		REQUIRE(data.canonicalTerm(4) == 1);
+	}
+	SECTION("disable") {
+		data.setSharing(false);
+		REQUIRE(data.canonicalTerm(5) == 5);
+		data.addTerm(7, 0, toSpan(args));
+		REQUIRE(data.getTerm(7).begin() != data.getTerm(4).begin());
+	}
+}
+
+TEST_CASE("Test AtomCompactor", "[aspif]") {
+	ReadObserver observer;
+	AtomCompactor compactor(observer);
+	compactor.initProgram(true);
+	compactor.beginStep();
+	Vec<Atom_t> head = {100, 7};
+	Vec<Lit_t>  body = {-3000, 7};
+	compactor.rule(Head_t::Choice, toSpan(head), toSpan(body));
+	auto wb = Vec<WeightLit_t>{{-100, 2}, {42, 1}};
+	compactor.rule(Head_t::Disjunctive, Potassco::toSpan<Atom_t>(), 1, toSpan(wb));
+	compactor.minimize(0, toSpan(wb));
+	Vec<Lit_t> cond = {3000};
+	compactor.output(toSpan("foo"), toSpan(cond));
+	compactor.external(9, Value_t::Free);
+	Vec<Atom_t> proj = {42, 9};
+	compactor.project(toSpan(proj));
+	compactor.heuristic(50, Heuristic_t::Sign, 1, 0, toSpan(cond));
+	compactor.theoryTerm(0, 1);
+	compactor.theoryAtom(60, 0, Potassco::toSpan<Id_t>());
+	compactor.endStep();
+
+	REQUIRE(compactor.maxAtom() == 7);
+	REQUIRE(observer.rules.size() == 2);
+	REQUIRE(observer.rules[0] == Rule{Head_t::Choice, {1, 2}, Body_t::Normal, BOUND_NONE, {{-3, 1}, {2, 1}}});
+	REQUIRE(observer.rules[1] == Rule{Head_t::Disjunctive, {}, Body_t::Sum, 1, {{-1, 2}, {4, 1}}});
+	REQUIRE(observer.min[0].second == (Vec<WeightLit_t>{{-1, 2}, {4, 1}}));
+	REQUIRE(observer.shows[0].second == Vec<Lit_t>{3});
+	REQUIRE(observer.externals[0].first == 5);
+	REQUIRE(observer.projects == (Vec<Atom_t>{4, 5}));
+	REQUIRE(observer.heuristics[0].atom == 6);
+	REQUIRE((*observer.theory.currBegin())->atom() == 7);
+	REQUIRE(compactor.get(-3000) == -3);
+	REQUIRE(compactor.get(3001) == 0);
+	REQUIRE(compactor.original(2) == 7);
+	REQUIRE(compactor.original(8) == 0);
+
+	SECTION("mapping is kept across steps") {
+		compactor.beginStep();
+		head = {3001, 100};
+		compactor.rule(Head_t::Disjunctive, toSpan(head), Potassco::toSpan<Lit_t>());
+		compactor.endStep();
+		REQUIRE(observer.nStep == 2);
+		REQUIRE(observer.rules.back() == Rule{Head_t::Disjunctive, {8, 1}, Body_t::Normal, BOUND_NONE, {}});
+		REQUIRE(compactor.original(8) == 3001);
+		REQUIRE(compactor.maxAtom() == 8);
+	}
+}
+
+TEST_CASE("Test DuplicateFilter", "[aspif]") {
+	ReadObserver observer;
+	DuplicateFilter::Options opts;
+	SECTION("global scope") {}
+	SECTION("step scope") { opts.perStep(); }
+	SECTION("filter minimize") { opts.filterMinimize(); }
+	DuplicateFilter filter(observer, opts);
+	filter.initProgram(true);
+	filter.beginStep();
+	Vec<Atom_t> h1 = {1, 2}, h2 = {2, 1, 2};
+	Vec<Lit_t>  b1 = {-3, 4}, b2 = {4, -3, 4};
+	filter.rule(Head_t::Disjunctive, toSpan(h1), toSpan(b1));
+	filter.rule(Head_t::Disjunctive, toSpan(h2), toSpan(b2));
+	filter.rule(Head_t::Choice, toSpan(h1), toSpan(b1));
+	filter.rule(Head_t::Disjunctive, toSpan(h1.data(), 1), toSpan(b1));
+	auto w1 = Vec<WeightLit_t>{{1, 2}, {-3, 1}, {1, 2}};
+	auto w2 = Vec<WeightLit_t>{{1, 2}, {1, 2}, {-3, 1}};
+	auto w3 = Vec<WeightLit_t>{{1, 2}, {-3, 1}};
+	filter.rule(Head_t::Disjunctive, toSpan(h1), 2, toSpan(w1));
+	filter.rule(Head_t::Disjunctive, toSpan(h1), 2, toSpan(w2));
+	filter.rule(Head_t::Disjunctive, toSpan(h1), 2, toSpan(w3));
+	filter.rule(Head_t::Disjunctive, toSpan(h1), 3, toSpan(w3));
+	filter.minimize(0, toSpan(w1));
+	filter.minimize(0, toSpan(w2));
+	filter.output(toSpan("a"), toSpan(b1));
+	filter.output(toSpan("a"), toSpan(b2));
+	filter.output(toSpan("ab"), toSpan(b2));
+	filter.endStep();
+	REQUIRE(observer.rules.size() == 6);
+	REQUIRE(observer.shows.size() == 2);
+	REQUIRE(observer.min.size() == (opts.minimize ? 1u : 2u));
+	REQUIRE(filter.duplicates() == (opts.minimize ? 4u : 3u));
+	filter.beginStep();
+	filter.rule(Head_t::Disjunctive, toSpan(h2), toSpan(b2));
+	filter.endStep();
+	REQUIRE(observer.rules.size() == (opts.stepScope ? 7u : 6u));
+}
+
+// Assignment over atoms 1..n, where the trail contains the literals in the order given.
+struct TrailAssignment : AbstractAssignment {
+	explicit TrailAssignment(const Vec<Lit_t>& t) : trail_(t) {}
+	virtual uint32_t size()            const { return static_cast<uint32_t>(trail_.size()); }
+	virtual uint32_t unassigned()      const { return 0; }
+	virtual bool     hasConflict()     const { return false; }
+	virtual uint32_t level()           const { return 0; }
+	virtual uint32_t rootLevel()       const { return 0; }
+	virtual bool     hasLit(Lit_t lit) const { return atom(lit) <= size(); }
+	virtual Value_t  value(Lit_t lit)  const {
+		++calls;
+		Lit_t x = find(lit);
+		return x == 0 ? Value_t::Free : (x == lit ? Value_t::True : Value_t::False);
+	}
+	virtual uint32_t level(Lit_t lit)  const { ++calls; return find(lit) ? 0u : UINT32_MAX; }
+	virtual Lit_t    decision(uint32_t)const { return 0; }
+	virtual uint32_t trailSize()       const { return size(); }
+	virtual Lit_t    trailAt(uint32_t pos)      const { ++calls; return trail_[pos]; }
+	virtual uint32_t trailBegin(uint32_t)       const { return 0; }
+	Lit_t find(Lit_t lit) const {
+		for (Lit_t x : trail_) { if (atom(x) == atom(lit)) { return x; } }
+		return 0;
+	}
+	Vec<Lit_t>       trail_;
+	mutable uint32_t calls = 0;
+};
+TEST_CASE("Test AbstractAssignment batch queries", "[clingo]") {
+	TrailAssignment a({3, -1, 4});
+	Vec<Lit_t> lits = {1, -1, 2, 3, -4};
+	SECTION("values") {
+		Value_t out[5];
+		a.values(toSpan(lits), out);
+		REQUIRE(a.calls == 5);
+		REQUIRE(out[0] == Value_t::False);
+		REQUIRE(out[1] == Value_t::True);
+		REQUIRE(out[2] == Value_t::Free);
+		REQUIRE(out[3] == Value_t::True);
+		REQUIRE(out[4] == Value_t::False);
+	}
+	SECTION("levels") {
+		uint32_t out[5];
+		a.levels(toSpan(lits), out);
+		REQUIRE(a.calls == 5);
+		REQUIRE((out[0] == 0 && out[1] == 0 && out[2] == UINT32_MAX && out[3] == 0 && out[4] == 0));
+	}
+	SECTION("trail copies to buffer") {
+		Lit_t buf[3] = {0, 0, 0};
+		LitSpan seg = a.trail(1, 2, buf);
+		REQUIRE(seg.first == buf);
+		REQUIRE(toVec(seg) == Vec<Lit_t>({-1, 4}));
+		REQUIRE(a.calls == 2);
+		seg = a.trail(3, 0, buf);
+		REQUIRE(seg.size == 0);
+		REQUIRE(a.calls == 2);
+	}
+	SECTION("trail view") {
+		struct ViewAssignment : TrailAssignment {
+			explicit ViewAssignment(const Vec<Lit_t>& t) : TrailAssignment(t) {}
+			virtual LitSpan trail(uint32_t pos, uint32_t n, Lit_t*) const { return toSpan(trail_.data() + pos, n); }
+		} v({3, -1, 4});
+		const AbstractAssignment& base = v;
+		LitSpan seg = base.trail(1, 2, nullptr);
+		REQUIRE(seg.first == v.trail_.data() + 1);
+		REQUIRE(toVec(seg) == Vec<Lit_t>({-1, 4}));
+		REQUIRE(v.calls == 0);
+	}
+}
+TEST_CASE("Test FactPropagator", "[aspif]") {
+	ReadObserver observer;
+	FactPropagator prop(observer);
+	prop.initProgram(true);
+	prop.beginStep();
+	RuleBuilder rb;
+	rb.start().addHead(3).startBody().addGoal(2).end(&prop);             // becomes fact in second pass
+	rb.start().addHead(4).startBody().addGoal(3).addGoal(6).end(&prop);  // 4 :- 6.
+	rb.start().addHead(2).startBody().addGoal(1).end(&prop);             // becomes fact
+	rb.start().addHead(1).end(&prop);                                    // fact
+	rb.start().addHead(1).end(&prop);                                    // duplicate fact
+	rb.start().addHead(5).addHead(6).startBody().addGoal(-7).end(&prop); // head contains no fact
+	rb.start().addHead(6).startBody().addGoal(-1).end(&prop);            // false body
+	rb.start(Head_t::Choice).addHead(1).addHead(7).end(&prop);           // {7}.
+	rb.start().addHead(8).startSum(3).addGoal(1, 2).addGoal(-2, 5).addGoal(6, 1).end(&prop); // 8 :- 6.
+	rb.start().addHead(9).startSum(3).addGoal(-1, 2).addGoal(6, 1).end(&prop);               // false body
+	prop.output(toSpan("a"), toSpan(Vec<Lit_t>{1, 6}));
+	prop.output(toSpan("b"), toSpan(Vec<Lit_t>{-3}));
+	prop.endStep();
+	REQUIRE(prop.isFact(1));
+	REQUIRE(prop.isFact(2));
+	REQUIRE(prop.isFact(3));
+	REQUIRE_FALSE(prop.isFact(4));
+	REQUIRE(observer.rules == (Vec<Rule>{
+		{Head_t::Disjunctive, {3}, Body_t::Normal, BOUND_NONE, {}},
+		{Head_t::Disjunctive, {4}, Body_t::Normal, BOUND_NONE, {{6, 1}}},
+		{Head_t::Disjunctive, {2}, Body_t::Normal, BOUND_NONE, {}},
+		{Head_t::Disjunctive, {1}, Body_t::Normal, BOUND_NONE, {}},
+		{Head_t::Disjunctive, {5, 6}, Body_t::Normal, BOUND_NONE, {{-7, 1}}},
+		{Head_t::Choice, {7}, Body_t::Normal, BOUND_NONE, {}},
+		{Head_t::Disjunctive, {8}, Body_t::Sum, 1, {{6, 1}}},
+	}));
+	REQUIRE(observer.shows.size() == 1);
+	REQUIRE(observer.shows[0].second == Vec<Lit_t>{6});
+	REQUIRE(prop.removed() == 4);
+
+	SECTION("facts are kept across steps") {
+		prop.beginStep();
+		rb.start().addHead(10).startBody().addGoal(-3).end(&prop);
+		rb.start().addHead(11).startBody().addGoal(3).addGoal(10).end(&prop);
+		prop.external(12, Value_t::True);
+		rb.start().addHead(13).startBody().addGoal(12).end(&prop);
+		prop.endStep();
+		REQUIRE(observer.rules.size() == 9);
+		REQUIRE(observer.rules[7] == Rule{Head_t::Disjunctive, {11}, Body_t::Normal, BOUND_NONE, {{10, 1}}});
+		REQUIRE(observer.rules[8] == Rule{Head_t::Disjunctive, {13}, Body_t::Normal, BOUND_NONE, {{12, 1}}});
+		REQUIRE(observer.externals.size() == 1);
+	}
+	SECTION("bound stays in range") {
+		prop.beginStep();
+		Atom_t h = 14;
+		Vec<WeightLit_t> body = {{1, INT_MAX}, {6, INT_MIN}, {7, INT_MIN}};
+		prop.rule(Head_t::Disjunctive, toSpan(&h, 1), INT_MIN + 1, toSpan(body));
+		prop.endStep();
+		REQUIRE(observer.rules.size() == 8);
+		REQUIRE(observer.rules[7] == Rule{Head_t::Disjunctive, {14}, Body_t::Sum, INT_MIN + 1, {{1, INT_MAX}, {6, INT_MIN}, {7, INT_MIN}}});
+	}
+}
 
 }}}
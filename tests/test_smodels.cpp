@@ -27,6 +27,8 @@
 #include <potassco/convert.h>
 #include <sstream>
 #include <cstring>
+#include <cstdio>
+#include <ctime>
 #include <map>
 #include <unordered_map>
 namespace Potassco {
@@ -176,6 +178,27 @@ TEST_CASE("Smodels reader ", "[smodels]") {
 		REQUIRE(observer.atoms[2] == "Bar");
 		REQUIRE(observer.atoms[3] == "Test(X,Y)");
 	}
+	SECTION("read long atom names") {
+		std::vector<std::string> names;
+		for (int i = 1; i != 200; ++i) {
+			names.push_back(std::string(static_cast<std::size_t>(i * 37), static_cast<char>('a' + (i % 26))));
+		}
+		names.push_back(std::string(3 * BufferedStream::BUF_SIZE, 'x'));
+		input << "0\n";
+		for (std::size_t i = 0; i != names.size(); ++i) {
+			input << (i + 1) << " " << names[i] << (i % 2 ? "\r\n" : "\n");
+		}
+		input << "0\nB+\n0\nB-\n0\n1\n";
+		REQUIRE(Potassco::readSmodels(input, observer) == 0);
+		REQUIRE(observer.atoms.size() == names.size());
+		for (std::size_t i = 0; i != names.size(); ++i) {
+			REQUIRE(observer.atoms[static_cast<int>(i + 1)] == names[i]);
+		}
+	}
+	SECTION("atom names must be terminated by newline") {
+		input << "0\n1 Foo";
+		REQUIRE_THROWS(Potassco::readSmodels(input, observer));
+	}
 	SECTION("read compute") {
 		finalize(input, {}, "2\n3", "1\n4\n5");
 		REQUIRE(Potassco::readSmodels(input, observer) == 0);
@@ -385,6 +408,90 @@ TEST_CASE("Match heuristic predicate", "[smodels]") {
 }
 
 
+TEST_CASE("Match edge predicate", "[smodels]") {
+	const char* in;
+	StringSpan  n0, n1;
+	SECTION("do not match invalid predicate name") {
+		REQUIRE(0 == matchEdgePred(in = "edge(1,2)", n0, n1));
+		REQUIRE(0 == matchEdgePred(in = "_e", n0, n1));
+		REQUIRE(0 == matchEdgePred(in = "_acyc", n0, n1));
+		REQUIRE(0 == matchEdgePred(in = "_acyc_1_2", n0, n1));
+		REQUIRE(0 == matchEdgePred(in = "_acyc_1_a_2", n0, n1));
+	}
+	SECTION("match _acyc_ predicate") {
+		REQUIRE(1 == matchEdgePred(in = "_acyc_1_1234_-4321", n0, n1));
+		REQUIRE(std::string(begin(n0), end(n0)) == "1234");
+		REQUIRE(std::string(begin(n1), end(n1)) == "-4321");
+		REQUIRE(*in == 0);
+	}
+	SECTION("match _edge/2 predicate") {
+		REQUIRE(1 == matchEdgePred(in = "_edge(f(x,y),\"a)\")", n0, n1));
+		REQUIRE(std::string(begin(n0), end(n0)) == "f(x,y)");
+		REQUIRE(std::string(begin(n1), end(n1)) == "\"a)\"");
+		REQUIRE(-1 == matchEdgePred(in = "_edge(x)", n0, n1));
+		REQUIRE(-2 == matchEdgePred(in = "_edge(x,y,z)", n0, n1));
+	}
+}
+
+TEST_CASE("Smodels reader processes symbol table in parallel", "[smodels]") {
+	std::stringstream input;
+	input << "0\n";
+	char buf[64];
+	for (int i = 1; i <= 20000; ++i) {
+		switch (i % 4) {
+			case 0:  std::sprintf(buf, "_edge(n(%d),n(%d))", i % 100, (i + 1) % 100); break;
+			case 1:  std::sprintf(buf, "_heuristic(p(%d),level,%d,%d)", i + 2, i % 7, i % 3); break;
+			default: std::sprintf(buf, "p(%d)", i); break;
+		}
+		input << i << " " << buf << "\n";
+	}
+	input << "0\nB+\n0\nB-\n0\n1\n";
+	SmodelsInput::Options opts;
+	opts.convertEdges().convertHeuristic();
+	SECTION("keep converted") {}
+	SECTION("drop converted") { opts.dropConverted(); }
+	ReadObserver serial, parallel;
+	std::stringstream copy(input.str());
+	REQUIRE(readSmodels(input, serial, 0, opts) == 0);
+	REQUIRE(readSmodels(copy, parallel, 0, opts.symbolThreads(4)) == 0);
+	REQUIRE(serial.heuristics.size() == 5000);
+	REQUIRE(serial.heuristics[0] == Heuristic{3, Heuristic_t::Level, 1, 1, {1}});
+	REQUIRE(serial.edges.size() == 5000);
+	REQUIRE(serial.atoms.size() == (opts.filter ? 10000u : 20000u));
+	REQUIRE(serial.heuristics == parallel.heuristics);
+	REQUIRE(serial.edges == parallel.edges);
+	REQUIRE(serial.atoms == parallel.atoms);
+}
+
+TEST_CASE("Benchmark predicate matching", "[.bench]") {
+	std::vector<std::string> names;
+	char buf[64];
+	for (int i = 0; i != 300000; ++i) {
+		switch (i % 10) {
+			case 0:  std::sprintf(buf, "_edge(n(%d),n(%d))", i, i + 1); break;
+			case 1:  std::sprintf(buf, "_acyc_1_%d_%d", i, i + 1); break;
+			case 2:  std::sprintf(buf, "_heuristic(p(%d),level,%d,%d)", i, i % 7, i % 3); break;
+			case 3:  std::sprintf(buf, "_heuristic(q(%d),false,-%d)", i, i % 5); break;
+			default: std::sprintf(buf, "holds(at(%d,%d),step(%d))", i % 97, i % 31, i); break;
+		}
+		names.push_back(buf);
+	}
+	StringSpan  n0, n1;
+	Heuristic_t type;
+	int         bias;
+	unsigned    prio, matched = 0;
+	std::clock_t start = std::clock();
+	for (int r = 0; r != 10; ++r) {
+		for (std::vector<std::string>::const_iterator it = names.begin(), end = names.end(); it != end; ++it) {
+			const char* n = it->c_str();
+			if (matchEdgePred(n, n0, n1) > 0 || matchDomHeuPred(n, n0, type, bias, prio) > 0) { ++matched; }
+		}
+	}
+	double secs = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+	WARN("matched " << matched << " of " << 10 * names.size() << " names in " << secs << "s");
+	REQUIRE(matched == 10 * 4 * (names.size() / 10));
+}
+
 TEST_CASE("SmodelsOutput supports extended programs", "[smodels_ext]") {
 	std::stringstream str, exp;
 	SmodelsOutput out(str, true, 0);
@@ -461,6 +568,40 @@ TEST_CASE("Convert to smodels", "[convert]") {
 		REQUIRE(observer.rules[Rule_t::Optimize][0] == m3);
 		REQUIRE(observer.rules[Rule_t::Optimize][1] == m10);
 	}
+	SECTION("convert minimize merges duplicate literals") {
+		AggLits m1 = {{4, 1}, {-3, 2}, {4, 3}, {5, 1}, {-5, 1}};
+		AggLits m2 = {{-3, 2}, {5, -1}, {6, INT_MAX}, {6, 1}, {-2, 1}};
+		convert.minimize(1, {begin(m1), m1.size()});
+		convert.minimize(1, {begin(m2), m2.size()});
+		convert.minimize(2, {begin(m2), 1});
+		convert.endStep();
+		REQUIRE(observer.rules[Rule_t::Optimize].size() == 2);
+		RawRule e1 = {1, convert.get(4), 4, convert.get(-3), 4, convert.get(5), 1, convert.get(-5), 2, convert.get(6), INT_MAX, convert.get(6), 1, convert.get(-2), 1};
+		RawRule e2 = {2, convert.get(-3), 2};
+		REQUIRE(observer.rules[Rule_t::Optimize][0] == e1);
+		REQUIRE(observer.rules[Rule_t::Optimize][1] == e2);
+	}
+	SECTION("convert minimize keeps priorities without literals") {
+		AggLits m1 = {{4, 0}, {-3, 0}, {4, 0}};
+		AggLits m2 = {{5, 1}};
+		convert.minimize(1, {begin(m1), m1.size()});
+		convert.minimize(2, toSpan<WeightLit_t>());
+		convert.minimize(3, {begin(m2), m2.size()});
+		convert.endStep();
+		REQUIRE(observer.rules[Rule_t::Optimize].size() == 3);
+		REQUIRE(observer.rules[Rule_t::Optimize][0] == RawRule({1}));
+		REQUIRE(observer.rules[Rule_t::Optimize][1] == RawRule({2}));
+		REQUIRE(observer.rules[Rule_t::Optimize][2] == RawRule({3, convert.get(5), 1}));
+	}
+	SECTION("convert rule with sparse atoms") {
+		Atom_t a = atomMax;
+		BodyLits lits = {static_cast<Lit_t>(atomMax - 1), -2};
+		convert.rule(Head_t::Disjunctive, {&a, 1}, {begin(lits), lits.size()});
+		REQUIRE(convert.maxAtom() == 4);
+		RawRule r = {convert.get(a), convert.get(lits.begin()[0]), convert.get(-2)};
+		REQUIRE(r == RawRule({2, 3, -4}));
+		REQUIRE(observer.rules[Rule_t::Basic][0] == r);
+	}
 	SECTION("convert output") {
 		LitVec c = {1, -2, 3};
 		convert.output({"Foo", 3}, toSpan(c));
@@ -470,6 +611,40 @@ TEST_CASE("Convert to smodels", "[convert]") {
 		Atom_t aux = observer.rules[Rule_t::Basic][0][0];
 		REQUIRE(std::strcmp(convert.getName(aux), "Foo") == 0);
 	}
+	SECTION("convert output reuses atoms of equivalent conditions") {
+		LitVec c1 = {1, -2, 3}, c2 = {3, 1, -2, 1}, c3 = {1, 2, 3};
+		convert.output({"Foo", 3}, toSpan(c1));
+		convert.output({"Bar", 3}, toSpan(c2));
+		convert.output({"Baz", 3}, toSpan(c3));
+		convert.endStep();
+		REQUIRE(observer.rules[Rule_t::Basic].size() == 3);
+		int aux = observer.rules[Rule_t::Basic][0][0];
+		int bar = observer.rules[Rule_t::Basic][1][0];
+		REQUIRE(observer.rules[Rule_t::Basic][1] == RawRule({bar, aux}));
+		REQUIRE(observer.rules[Rule_t::Basic][2][0] != aux);
+		REQUIRE(observer.atoms[aux] == "Foo");
+		REQUIRE(observer.atoms[bar] == "Bar");
+		convert.beginStep();
+		convert.output({"Foo2", 4}, toSpan(c2));
+		convert.endStep();
+		REQUIRE(observer.rules[Rule_t::Basic].size() == 4);
+		int foo2 = observer.rules[Rule_t::Basic][3][0];
+		REQUIRE(observer.rules[Rule_t::Basic][3] == RawRule({foo2, aux}));
+		REQUIRE(observer.atoms[foo2] == "Foo2");
+		REQUIRE(observer.atoms[aux] == "Foo");
+	}
+	SECTION("condition table is bounded by its limit") {
+		LitVec c1 = {1, -2, 3};
+		convert.setConditionLimit(1);
+		convert.output({"Foo", 3}, toSpan(c1));
+		convert.endStep();
+		convert.beginStep();
+		convert.output({"Bar", 3}, toSpan(c1));
+		convert.endStep();
+		REQUIRE(observer.rules[Rule_t::Basic].size() == 2);
+		REQUIRE(observer.rules[Rule_t::Basic][1].size() == 4);
+		REQUIRE(observer.rules[Rule_t::Basic][1][0] != observer.rules[Rule_t::Basic][0][0]);
+	}
 
 	SECTION("convert external") {
 		convert.external(1, Value_t::Free);
@@ -541,6 +716,42 @@ inline StringSpan toSpan(const char* str) {
 }
 using Potassco::toSpan;
 
+static void convertLarge(std::ostream& os, std::size_t spillLimit) {
+	SmodelsOutput  writer(os, true, 0);
+	SmodelsConvert convert(writer, true);
+	convert.setSpillLimit(spillLimit);
+	convert.initProgram(true);
+	for (int step = 0; step != 2; ++step) {
+		convert.beginStep();
+		char name[32];
+		for (Atom_t a = 1; a != 3000; ++a) {
+			Atom_t h = a + static_cast<Atom_t>(step * 3000);
+			Lit_t  b = -static_cast<Lit_t>(h + 1);
+			convert.rule(Head_t::Choice, toSpan(&h, 1), toSpan<Lit_t>());
+			std::sprintf(name, "a(%u)", static_cast<unsigned>(h));
+			convert.output(toSpan(name), toSpan(&b, 1));
+			WeightLit_t wl = {static_cast<Lit_t>((h % 97) + 1), static_cast<Weight_t>(h % 5) - 2};
+			convert.minimize(static_cast<Weight_t>(h % 3), toSpan(&wl, 1));
+			if (h % 7 == 0) { convert.external(h + 1, Value_t::Free); }
+			if (h % 11 == 0) { convert.heuristic(h, Heuristic_t::Sign, 1, 2, toSpan(&b, 1)); }
+			if (h % 13 == 0) { convert.acycEdge(static_cast<int>(h), 1, toSpan(&b, 1)); }
+		}
+		convert.endStep();
+	}
+}
+TEST_CASE("Convert to smodels with spilling", "[convert]") {
+	std::stringstream exp, str;
+	convertLarge(exp, 0);
+	convertLarge(str, 1024);
+	REQUIRE(exp.str().size() > 10000);
+	REQUIRE(str.str() == exp.str());
+	SECTION("merge of many runs takes several passes") {
+		std::stringstream many;
+		convertLarge(many, 1);
+		REQUIRE(many.str() == exp.str());
+	}
+}
+
 TEST_CASE("Test Atom to directive conversion", "[clasp]") {
 	ReadObserver observer;
 	std::stringstream str;
@@ -26,6 +26,7 @@
 #include "test_common.h"
 #include <potassco/aspif_text.h>
 #include <potassco/aspif.h>
+#include <potassco/string_convert.h>
 #include <sstream>
 namespace Potassco {
 namespace Test {
@@ -335,6 +336,24 @@ TEST_CASE("Text writer ", "[text]") {
 	}
 }
 
+TEST_CASE("Text writer renders directives in parallel", "[text]") {
+	std::stringstream input, serial, parallel;
+	for (int i = 1; i <= 5000; ++i) {
+		input << "x" << i << " :- x" << (i + 1) << ", not x" << (i + 2) << ".\n";
+		input << "#minimize{x" << i << "=" << i << "}@" << (i % 3) << ".\n";
+		if (i % 7 == 0) { input << "#output p(" << i << ") : x" << i << ".\n"; }
+	}
+	std::string prg = input.str();
+	AspifTextOutput s(serial), p(parallel);
+	p.setThreads(4);
+	std::stringstream in1(prg), in2(prg);
+	AspifTextInput r1(&s), r2(&p);
+	REQUIRE(read(r1, in1));
+	REQUIRE(read(r2, in2));
+	REQUIRE(parallel.str() == serial.str());
+	REQUIRE(serial.str().find("p(7) :- x_8, not x_9.\n#minimize{p(7)=7}@1.\n") != std::string::npos);
+}
+
 TEST_CASE("Text writer writes theory", "[text]") {
 	std::stringstream output;
 	AspifTextOutput out(output);
@@ -455,4 +474,82 @@ TEST_CASE("Text writer writes theory", "[text]") {
 			"&diff{end(2) - start(2)} <= 600.\n");
 	}
 }
+TEST_CASE("TheoryAtomStringBuilder caches compound terms", "[text]") {
+	struct Builder : TheoryAtomStringBuilder {
+		virtual LitSpan     getCondition(Id_t) const { return toSpan<Lit_t>(); }
+		virtual std::string getName(Atom_t) const    { return ""; }
+	} builder;
+	TheoryData td;
+	std::vector<Id_t> ids;
+	td.addTerm(0, "sum");
+	td.addTerm(1, "+");
+	td.addTerm(2, "x");
+	td.addTerm(3, 1);
+	td.addTerm(4, 1, toSpan(ids = {2, 3}));
+	td.addTerm(5, Tuple_t::Paren, toSpan(ids = {4, 4}));
+	td.addElement(0, toSpan(ids = {5}), 0);
+	const TheoryAtom& a = td.addAtom(0, 0, toSpan(ids = {0}));
+	REQUIRE(builder.toString(td, a) == "&sum{(x + 1, x + 1)}");
+	SECTION("append to string builder") {
+		std::string res("a :- ");
+		StringBuilder out(res);
+		builder.toString(td, a, out).append(".");
+		REQUIRE(res == "a :- &sum{(x + 1, x + 1)}.");
+	}
+	SECTION("cache is valid after update") {
+		td.update();
+		td.addTerm(6, 7);
+		td.addTerm(7, Tuple_t::Paren, toSpan(ids = {4, 6}));
+		td.addElement(1, toSpan(ids = {7}), 0);
+		const TheoryAtom& b = td.addAtom(0, 0, toSpan(ids = {1}));
+		REQUIRE(builder.toString(td, b) == "&sum{(x + 1, 7)}");
+	}
+	SECTION("removed terms invalidate cache") {
+		td.update();
+		td.addTerm(4, 1, toSpan(ids = {3, 2}));
+		REQUIRE(builder.toString(td, a) == "&sum{(1 + x, 1 + x)}");
+	}
+	SECTION("truncated output is not cached") {
+		builder.clearCache();
+		char buf[10];
+		StringBuilder out(buf, sizeof(buf));
+		builder.toString(td, a, out);
+		REQUIRE(std::string(out.c_str()) == "&sum{(x +");
+		REQUIRE(builder.toString(td, a) == "&sum{(x + 1, x + 1)}");
+	}
+	SECTION("sparse term ids") {
+		td.addTerm(1000000000u, 1, toSpan(ids = {3, 2}));
+		td.addElement(1, toSpan(ids = {1000000000u}), 0);
+		const TheoryAtom& b = td.addAtom(1, 0, toSpan(ids = {1}));
+		REQUIRE(builder.toString(td, b) == "&sum{1 + x}");
+		REQUIRE(builder.toString(td, b) == "&sum{1 + x}");
+	}
+	SECTION("long nested terms") {
+		std::string exp = "x";
+		Id_t last = 2;
+		for (Id_t id = 10; id != 3010; ++id) {
+			td.addTerm(id, 1, toSpan(ids = {last, 2}));
+			exp.append(" + x");
+			last = id;
+		}
+		td.addElement(1, toSpan(ids = {last}), 0);
+		const TheoryAtom& b = td.addAtom(1, 0, toSpan(ids = {1}));
+		exp = "&sum{" + exp + "}";
+		REQUIRE(builder.toString(td, b) == exp);
+		REQUIRE(builder.toString(td, b) == exp);
+	}
+	SECTION("cache is not reused for a different object") {
+		td.~TheoryData();
+		new (&td) TheoryData();
+		td.addTerm(0, "sum");
+		td.addTerm(1, "-");
+		td.addTerm(2, "y");
+		td.addTerm(3, 2);
+		td.addTerm(4, 1, toSpan(ids = {2, 3}));
+		td.addTerm(5, Tuple_t::Paren, toSpan(ids = {4, 4}));
+		td.addElement(0, toSpan(ids = {5}), 0);
+		const TheoryAtom& b = td.addAtom(0, 0, toSpan(ids = {0}));
+		REQUIRE(builder.toString(td, b) == "&sum{(y - 2, y - 2)}");
+	}
+}
 }}}